@@ -0,0 +1,179 @@
+/******************************************************************************
+    Copyright (C) Martin Karsten 2015-2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+// coroutine echo test: a server executor accepts connections and echoes on
+// each of them, a client executor runs one coroutine per connection that
+// verifies a number of echoed messages, yields, sleeps, and updates a
+// shared counter under a coroutine mutex - all connections of each side
+// share one fibre stack (requires library built with TESTING_COROUTINES and
+// make CXXSTD=c++20)
+
+#include "fibre.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <unistd.h> // getopt
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+using namespace std;
+
+#if TESTING_COROUTINES && __cplusplus >= 202002L
+#include "FibreCoroutine.h"
+
+static const size_t MsgSize = 32;
+
+static size_t threadCount = 4;
+static size_t connCount   = 500;
+static size_t roundCount  = 100;
+
+static volatile size_t served      = 0;
+static volatile size_t clientsDone = 0;
+static CoMutex         mutex;
+static size_t          shared      = 0;
+
+static void usage(const char* prog) {
+  cout << "usage: " << prog << " -c <connections> -n <rounds per connection> -t <workers>" << endl;
+}
+
+static void opts(int argc, char** argv) {
+  for (;;) {
+    int option = getopt(argc, argv, "c:n:t:h?");
+    if (option < 0) break;
+    switch (option) {
+    case 'c': connCount = atoi(optarg); break;
+    case 'n': roundCount = atoi(optarg); break;
+    case 't': threadCount = atoi(optarg); break;
+    case 'h':
+    case '?':
+      usage(argv[0]);
+      exit(0);
+    default:
+      cerr << "unknown option - " << (char)option << endl;
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (argc != optind) {
+    cerr << "unknown argument - " << argv[optind] << endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (threadCount == 0 || connCount == 0) {
+    cerr << "worker and connection count must be positive" << endl;
+    exit(1);
+  }
+}
+
+static CoTask<ssize_t> recvAll(int fd, char* buf, size_t len) {
+  size_t have = 0;
+  while (have < len) {
+    ssize_t ret = co_await lfCoRecv(fd, buf + have, len - have, 0);
+    if (ret <= 0) co_return ret;
+    have += ret;
+  }
+  co_return have;
+}
+
+static CoTask<> echo(int fd) {
+  char buf[MsgSize];
+  for (;;) {
+    ssize_t len = co_await lfCoRecv(fd, buf, sizeof(buf), 0);
+    if (len <= 0) break;
+    ssize_t sent = co_await lfCoSend(fd, buf, len, 0);
+    SYSCALL_EQ(sent, len);
+  }
+  SYSCALL(lfClose(fd));
+  __atomic_add_fetch(&served, 1, __ATOMIC_RELAXED);
+}
+
+static CoTask<> acceptor(CoExecutor* ex, int servFD) {
+  for (size_t n = 0; n < connCount; n += 1) {
+    int fd = co_await lfCoAccept(servFD, nullptr, nullptr);
+    ex->spawn(echo(SYSCALLIO(fd)));
+  }
+}
+
+static CoTask<> client(int fd, size_t id) {
+  for (size_t n = 0; n < roundCount; n += 1) {
+    char out[MsgSize];
+    char in[MsgSize];
+    snprintf(out, sizeof(out), "hello %zu %zu", id, n);
+    ssize_t sent = co_await lfCoSend(fd, out, sizeof(out), 0);
+    SYSCALL_EQ(sent, (ssize_t)sizeof(out));
+    ssize_t recvd = co_await recvAll(fd, in, sizeof(in));
+    SYSCALL_EQ(recvd, (ssize_t)sizeof(in));
+    RASSERT(memcmp(in, out, sizeof(out)) == 0, id, ' ', n);
+    if (n % 10 == 0) co_await CoYield();
+  }
+  co_await lfCoSleep(Time::fromMS(5));
+  co_await mutex.acquire();
+  shared += 1;
+  mutex.release();
+  SYSCALL(lfClose(fd));
+  __atomic_add_fetch(&clientsDone, 1, __ATOMIC_RELAXED);
+}
+
+int main(int argc, char** argv) {
+  opts(argc, argv);
+  FibreInit();
+  Context::CurrCluster().addWorkers(threadCount - 1);
+
+  int servFD = SYSCALLIO(lfSocket(AF_INET, SOCK_STREAM, 0, false));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  SYSCALL(lfBind(servFD, (sockaddr*)&addr, sizeof(addr)));
+  socklen_t addrlen = sizeof(addr);
+  SYSCALL(getsockname(servFD, (sockaddr*)&addr, &addrlen));
+  SYSCALL(lfListen(servFD, connCount));
+
+  auto start = chrono::steady_clock::now();
+  {
+    CoExecutor server, clients;
+    server.spawn(acceptor(&server, servFD));
+    for (size_t i = 0; i < connCount; i += 1) {
+      // connect on this fibre: coroutines must not block the executor fibre
+      int fd = SYSCALLIO(lfSocket(AF_INET, SOCK_STREAM, 0, false));
+      SYSCALL(lfConnect(fd, (sockaddr*)&addr, sizeof(addr)));
+      clients.spawn(client(fd, i));
+    }
+  } // executor destructors wait for all coroutines
+  auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+  SYSCALL(lfClose(servFD));
+
+  cout << "connections: " << connCount << " served: " << served << " clients: " << clientsDone
+       << " shared: " << shared << " round trips/s: " << (connCount * roundCount * 1000) / (elapsed ? elapsed : 1) << endl;
+  if (served != connCount || clientsDone != connCount || shared != connCount) {
+    cerr << "FAILED" << endl;
+    return 1;
+  }
+  return 0;
+}
+
+#else
+
+int main() {
+  cout << "coecho: requires TESTING_COROUTINES and C++20" << endl;
+  return 0;
+}
+
+#endif
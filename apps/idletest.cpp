@@ -0,0 +1,116 @@
+/******************************************************************************
+    Copyright (C) Martin Karsten 2015-2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+// idle/wake microbenchmark: a driver fibre repeatedly wakes a burst of
+// blocked fibres and waits for all of them, so that workers go idle and
+// are woken up in each round (use FibrePrintStats to see idle/wake counts)
+
+#include "fibre.h"
+
+#include <chrono>
+#include <iostream>
+#include <unistd.h> // getopt
+
+using namespace std;
+
+static size_t threadCount = 2;
+static size_t fibreCount  = 64;
+static size_t duration    = 5;
+static size_t workCount   = 0;
+static long long spinLimit = -1;
+
+static FredSemaphore* wakeSem;
+static FredSemaphore  doneSem(0);
+static volatile bool  running = true;
+
+static void usage(const char* prog) {
+  cout << "usage: " << prog << " -d <duration (secs)> -f <fibres> -s <idle spin limit (ns)> -t <workers> -w <work per wakeup (loops)>" << endl;
+}
+
+static void opts(int argc, char** argv) {
+  for (;;) {
+    int option = getopt(argc, argv, "d:f:s:t:w:h?");
+    if (option < 0) break;
+    switch (option) {
+    case 'd': duration = atoi(optarg); break;
+    case 'f': fibreCount = atoi(optarg); break;
+    case 's': spinLimit = atoll(optarg); break;
+    case 't': threadCount = atoi(optarg); break;
+    case 'w': workCount = atoi(optarg); break;
+    case 'h':
+    case '?':
+      usage(argv[0]);
+      exit(0);
+    default:
+      cerr << "unknown option - " << (char)option << endl;
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (argc != optind) {
+    cerr << "unknown argument - " << argv[optind] << endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (threadCount == 0 || fibreCount == 0) {
+    cerr << "worker and fibre count must be positive" << endl;
+    exit(1);
+  }
+}
+
+static void sleeper(FredSemaphore* sem) {
+  for (;;) {
+    sem->P();
+    if (!running) break;
+    for (size_t i = 0; i < workCount; i += 1) asm volatile("" ::: "memory");
+    doneSem.V();
+  }
+}
+
+int main(int argc, char** argv) {
+  opts(argc, argv);
+  FibreInit();
+  Context::CurrCluster().addWorkers(threadCount - 1);
+  if (spinLimit >= 0) Context::CurrCluster().setIdleSpin(spinLimit);
+
+  wakeSem = new FredSemaphore[fibreCount];
+  Fibre** fibres = new Fibre*[fibreCount];
+  for (size_t i = 0; i < fibreCount; i += 1) {
+    fibres[i] = new Fibre;
+    fibres[i]->run(sleeper, &wakeSem[i]);
+  }
+
+  size_t rounds = 0;
+  auto start = chrono::steady_clock::now();
+  auto end = start + chrono::seconds(duration);
+  while (chrono::steady_clock::now() < end) {
+    for (size_t i = 0; i < fibreCount; i += 1) wakeSem[i].V();
+    for (size_t i = 0; i < fibreCount; i += 1) doneSem.P();
+    rounds += 1;
+  }
+  auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+  running = false;
+  for (size_t i = 0; i < fibreCount; i += 1) wakeSem[i].V();
+  for (size_t i = 0; i < fibreCount; i += 1) delete fibres[i];
+  delete [] fibres;
+  delete [] wakeSem;
+
+  cout << "rounds: " << rounds << " wakeups/s: " << (rounds * fibreCount * 1000000000ull) / elapsed
+       << " ns/round: " << elapsed / (rounds ? rounds : 1) << endl;
+  return 0;
+}
@@ -0,0 +1,210 @@
+/******************************************************************************
+    Copyright (C) Martin Karsten 2015-2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#include "fibre.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>      // getopt, close
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_NODELAY
+
+/*-----------------------------------------------------------------------------
+ * Keep-alive request latency: each client connection sends a minimal HTTP
+ * GET request, waits for the complete response, and records the round-trip
+ * time.  Percentiles are reported across all connections.  The client works
+ * against 'webserver'; '-s' runs a built-in responder with the same response,
+ * which does not need the picohttpparser submodule.  Example:
+ *
+ * ./latency -s -t 2 &
+ * ./latency -c 16 -n 20000
+-----------------------------------------------------------------------------*/
+
+static bool server = false;
+static int numconn = 16;
+static int numreq = 10000;
+static int numworkers = 1;
+
+static const char* REQUEST = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+static const size_t QLEN = strlen(REQUEST);
+
+static const char* RESPONSE = "HTTP/1.1 200 OK\r\n" \
+                              "Content-Length: 15\r\n" \
+                              "Content-Type: text/html\r\n" \
+                              "Connection: keep-alive\r\n" \
+                              "Server: testserver\r\n" \
+                              "\r\n" \
+                              "Hello, World!\r\n";
+static const size_t RLEN = strlen(RESPONSE);
+
+static void usage(const char* prog) {
+  std::cerr << "usage: " << prog << " -a <addr> -c <conns> -n <requests per conn> -p <port> -t <workers> [-s]" << std::endl;
+}
+
+static void opts(int argc, char** argv, sockaddr_in& addr) {
+  struct addrinfo  hint = { 0, AF_INET, SOCK_STREAM, 0, 0, nullptr, nullptr, nullptr };
+  struct addrinfo* info = nullptr;
+  for (;;) {
+    int option = getopt( argc, argv, "a:c:n:p:st:h?" );
+    if ( option < 0 ) break;
+    switch(option) {
+    case 'a':
+      SYSCALL(getaddrinfo(optarg, nullptr, &hint, &info));
+      addr.sin_addr = ((sockaddr_in*)info->ai_addr)->sin_addr; // already filtered for AF_INET
+      freeaddrinfo(info);
+      break;
+    case 'c': numconn = atoi(optarg); break;
+    case 'n': numreq = atoi(optarg); break;
+    case 'p': addr.sin_port = htons(atoi(optarg)); break;
+    case 's': server = true; break;
+    case 't': numworkers = atoi(optarg); break;
+    case 'h':
+    case '?':
+      usage(argv[0]);
+      exit(1);
+    default:
+      std::cerr << "unknown option -" << (char)option << std::endl;
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (argc != optind) {
+    std::cerr << "unknown argument - " << argv[optind] << std::endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (numconn < 1 || numreq < 1 || numworkers < 1) {
+    usage(argv[0]);
+    exit(1);
+  }
+}
+
+static inline uint64_t nowNS() {
+  struct timespec ts;
+  SYSCALL(clock_gettime(CLOCK_MONOTONIC, &ts));
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void servconn(void* arg) {
+  intptr_t fd = (intptr_t)arg;
+  int on = 1;
+  SYSCALL(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const void*)&on, sizeof(int)));
+  // answer each request, i.e., each empty line terminating a header
+  size_t match = 0;
+  for (;;) {
+    char buf[1024];
+    ssize_t len = lfRecv(fd, (void*)buf, sizeof(buf), 0);
+    if (len <= 0) break;
+    for (ssize_t i = 0; i < len; i += 1) {
+      if (buf[i] == "\r\n\r\n"[match]) match += 1;
+      else match = (buf[i] == '\r') ? 1 : 0;
+      if (match == 4) {
+        SYSCALL_EQ(lfSend(fd, (const void*)RESPONSE, RLEN, 0), (ssize_t)RLEN);
+        match = 0;
+      }
+    }
+  }
+  SYSCALL(lfClose(fd));
+}
+
+static void servmain(sockaddr_in& addr) {
+  Context::CurrCluster().addWorkers(numworkers - 1);
+  int servFD = SYSCALLIO(lfSocket(AF_INET, SOCK_STREAM, 0));
+  int on = 1;
+  SYSCALL(setsockopt(servFD, SOL_SOCKET, SO_REUSEADDR, (const void*)&on, sizeof(int)));
+  SYSCALL(lfBind(servFD, (sockaddr*)&addr, sizeof(addr)));
+  SYSCALL(lfListen(servFD, 1024));
+  std::cout << "listening on " << inet_ntoa(addr.sin_addr) << ':' << ntohs(addr.sin_port) << std::endl;
+  for (;;) {
+    intptr_t fd = SYSCALLIO(lfAccept(servFD, nullptr, nullptr));
+    Fibre* f = Fibre::create();
+    f->detachDelete();
+    f->run(servconn, (void*)fd);
+  }
+}
+
+struct ClientConn {
+  sockaddr_in* server;
+  std::vector<uint64_t> lat;
+};
+
+static void clientconn(ClientConn* cc) {
+  int fd = SYSCALLIO(lfSocket(AF_INET, SOCK_STREAM, 0));
+  SYSCALL(lfConnect(fd, (sockaddr*)cc->server, sizeof(sockaddr_in)));
+  int on = 1;
+  SYSCALL(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const void*)&on, sizeof(int)));
+  cc->lat.reserve(numreq);
+  for (int n = 0; n < numreq; n += 1) {
+    uint64_t start = nowNS();
+    SYSCALL_EQ(lfSend(fd, (const void*)REQUEST, QLEN, 0), (ssize_t)QLEN);
+    // read header, then content as given by Content-Length
+    char buf[1024];
+    size_t have = 0;
+    size_t need = 0;
+    while (need == 0 || have < need) {
+      RASSERT(have < sizeof(buf) - 1, have);
+      have += SYSCALL_GE(lfRecv(fd, (void*)(buf + have), sizeof(buf) - 1 - have, 0), 1);
+      buf[have] = 0;
+      if (need > 0) continue;
+      char* end = strstr(buf, "\r\n\r\n");
+      if (!end) continue;
+      char* cl = strcasestr(buf, "Content-Length:");
+      need = (end - buf) + 4 + (cl && cl < end ? atoi(cl + 15) : 0);
+    }
+    RASSERT(have == need, have, ' ', need); // no pipelining
+    cc->lat.push_back(nowNS() - start);
+  }
+  SYSCALL(lfClose(fd));
+}
+
+static void clientmain(sockaddr_in& addr) {
+  Context::CurrCluster().addWorkers(numworkers - 1);
+  ClientConn* cc = new ClientConn[numconn];
+  Fibre** f = new Fibre*[numconn];
+  for (int n = 0; n < numconn; n += 1) {
+    cc[n].server = &addr;
+    f[n] = (new Fibre)->run(clientconn, &cc[n]);
+  }
+  for (int n = 0; n < numconn; n += 1) delete f[n];
+  delete [] f;
+  std::vector<uint64_t> all;
+  for (int n = 0; n < numconn; n += 1) all.insert(all.end(), cc[n].lat.begin(), cc[n].lat.end());
+  delete [] cc;
+  std::sort(all.begin(), all.end());
+  auto pct = [&](double p) { return all[std::min(all.size() - 1, size_t(p * all.size()))] / 1000; };
+  std::cout << "requests: " << all.size() << " latency us - p50: " << pct(0.5) << " p90: " << pct(0.9)
+            << " p99: " << pct(0.99) << " p99.9: " << pct(0.999) << " max: " << all.back() / 1000 << std::endl;
+}
+
+int main(int argc, char** argv) {
+#if defined(__FreeBSD__)
+  sockaddr_in addr = { sizeof(sockaddr_in), AF_INET, htons(8800), { INADDR_ANY }, { 0 } };
+#else // __linux__ below
+  sockaddr_in addr = { AF_INET, htons(8800), { INADDR_ANY }, { 0 } };
+#endif
+  opts(argc, argv, addr);
+  FibreInit();
+  if (server) servmain(addr);
+  else clientmain(addr);
+  return 0;
+}
@@ -0,0 +1,133 @@
+/******************************************************************************
+    Copyright (C) Martin Karsten 2015-2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+// stackless task microbenchmark: spawns a number of tasks, of which every
+// k-th one asks for promotion to a fibre and yields there, and verifies that
+// all tasks have run and the expected number has been promoted; the same
+// work is then run with detached fibres for comparison (requires library
+// built with TESTING_STACKLESS_TASKS)
+
+#include "fibre.h"
+
+#include <chrono>
+#include <iostream>
+#include <unistd.h> // getopt
+
+using namespace std;
+
+static size_t threadCount  = 1;
+static size_t taskCount    = 100000;
+static size_t promoteEvery = 1000;
+static size_t window       = 1000; // outstanding items, fibre stacks beyond StackCache are mapped
+
+static volatile size_t doneCount    = 0;
+static volatile size_t promoteCount = 0;
+
+static void usage(const char* prog) {
+  cout << "usage: " << prog << " -n <tasks> -p <promote every (0 = never)> -t <workers> -w <outstanding items>" << endl;
+}
+
+static void opts(int argc, char** argv) {
+  for (;;) {
+    int option = getopt(argc, argv, "n:p:t:w:h?");
+    if (option < 0) break;
+    switch (option) {
+    case 'n': taskCount = atoi(optarg); break;
+    case 'p': promoteEvery = atoi(optarg); break;
+    case 't': threadCount = atoi(optarg); break;
+    case 'w': window = atoi(optarg); break;
+    case 'h':
+    case '?':
+      usage(argv[0]);
+      exit(0);
+    default:
+      cerr << "unknown option - " << (char)option << endl;
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+  if (argc != optind) {
+    cerr << "unknown argument - " << argv[optind] << endl;
+    usage(argv[0]);
+    exit(1);
+  }
+  if (threadCount == 0 || taskCount == 0 || window == 0) {
+    cerr << "worker, task, and outstanding count must be positive" << endl;
+    exit(1);
+  }
+}
+
+static bool promote(size_t idx) {
+  return promoteEvery && idx % promoteEvery == 0;
+}
+
+#if TESTING_STACKLESS_TASKS
+static bool task(ptr_t arg, bool canBlock) {
+  size_t idx = (size_t)arg;
+  if (promote(idx)) {
+    if (!canBlock) return false;
+    __atomic_add_fetch(&promoteCount, 1, __ATOMIC_RELAXED);
+    Fibre::yield();
+  }
+  __atomic_add_fetch(&doneCount, 1, __ATOMIC_RELAXED);
+  return true;
+}
+#endif
+
+static void fibre(ptr_t arg) {
+  if (promote((size_t)arg)) Fibre::yield();
+  __atomic_add_fetch(&doneCount, 1, __ATOMIC_RELAXED);
+}
+
+static void finish(const char* label, chrono::steady_clock::time_point start) {
+  while (doneCount < taskCount) Fibre::yield();
+  auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+  cout << label << ": " << taskCount << " ns/item: " << elapsed / taskCount << endl;
+}
+
+int main(int argc, char** argv) {
+  opts(argc, argv);
+  FibreInit();
+  Context::CurrCluster().addWorkers(threadCount - 1);
+
+#if TESTING_STACKLESS_TASKS
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < taskCount; i += 1) {
+    while (i - doneCount >= window) Fibre::yield();
+    FibreTask::spawn(task, (ptr_t)i);
+  }
+  finish("tasks ", start);
+  size_t expected = promoteEvery ? (taskCount + promoteEvery - 1) / promoteEvery : 0;
+  if (doneCount != taskCount || promoteCount != expected) {
+    cerr << "FAILED - done: " << doneCount << " promoted: " << promoteCount << " expected: " << expected << endl;
+    return 1;
+  }
+#else
+  cout << "tasks: TESTING_STACKLESS_TASKS not enabled" << endl;
+#endif
+
+  doneCount = 0;
+  auto fstart = chrono::steady_clock::now();
+  for (size_t i = 0; i < taskCount; i += 1) {
+    while (i - doneCount >= window) Fibre::yield();
+    Fibre* f = Fibre::create();
+    f->detachDelete();
+    f->run(fibre, (ptr_t)i);
+  }
+  finish("fibres", fstart);
+  return 0;
+}
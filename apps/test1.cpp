@@ -32,7 +32,7 @@ static void* f1main(void*) {
   for (size_t i = 0; i < 100000; i += 1) {
     ScopedLock<FredMutex> sl(testmtx2);
     testmtx1.acquire();
-    counter += 1;
+    counter = counter + 1;
     testmtx1.release();
   }
   cout << "F1 specific " << (char)(uintptr_t)fibre_getspecific(key_test) << endl;
@@ -49,7 +49,7 @@ static void f2main() {
   for (size_t i = 0; i < 100000; i += 1) {
     ScopedLock<FredMutex> sl(testmtx2);
     testmtx1.acquire();
-    counter += 1;
+    counter = counter + 1;
     testmtx1.release();
   }
   cout << "F2 specific " << (char)(uintptr_t)fibre_getspecific(key_test) << endl;
@@ -242,7 +242,7 @@ static inline void dowork(volatile int* buffer, unsigned int steps) {
     // a little more work than just a single memory access helps with stability
     value += (buffer[i % workBufferSize] * 17) / 23 + 55;
   }
-  buffer[0] += value;
+  buffer[0] = buffer[0] + value;
 }
 
 #if defined(__cforall)
@@ -366,16 +366,16 @@ static void worker(void* arg) {
 #if HASTIMEDLOCK
       case 'T':
         if (!shim_mutex_timedlock(&locks[lck].mtx, randomizedFlag ? pseudoRandom() % timeout : timeout)) {
-          workers[num].failed += 1;
+          workers[num].failed = workers[num].failed + 1;
           goto lock_failed;
         } else break;
 #endif
       default: fprintf(stderr, "internal error: lock type\n"); abort();
     }
-    locks[lck].counter += 1;
+    locks[lck].counter = locks[lck].counter + 1;
     dowork(buffer, work_locked);
-    workers[num].counter += 2;
-    locks[lck].counter += 1;
+    workers[num].counter = workers[num].counter + 2;
+    locks[lck].counter = locks[lck].counter + 1;
     shim_mutex_unlock(&locks[lck].mtx);
 #if HASTIMEDLOCK
 lock_failed:
@@ -11,22 +11,25 @@ class FibreSupport():
         FibreSupport.saved = False
 
     def stop_handler(event):
-        if (gdb.lookup_symbol("_lfFredDebugList")[0] == None):
+        if (gdb.lookup_symbol("_lfFredDebugShards")[0] == None):
             print("WARNING: no fibre debugging support - did you enable TESTING_ENABLE_DEBUGGING?")
             return
         FibreSupport.list = []
         FibreSupport.active = {}
         FibreSupport.threads = {}
-        # traverse runtime stack list to build internal list of fibres
-        _lfFredDebugList = gdb.parse_and_eval("_lfFredDebugList")
+        # traverse runtime fibre lists (one per shard) to build internal list of fibres
+        _lfFredDebugShards = gdb.parse_and_eval("_lfFredDebugShards")
+        _lfFredDebugShardCount = int(gdb.parse_and_eval("_lfFredDebugShardCount"))
         _lfFredDebugLink = gdb.parse_and_eval("_lfFredDebugLink")
-        first = _lfFredDebugList['anchorLink'].address
-        next = _lfFredDebugList['anchorLink']['link'][_lfFredDebugLink]['next']
-        if (next == 0):
-            return
-        while (next != first):
-            FibreSupport.list.append(next)
-            next = next['link'][_lfFredDebugLink]['next']
+        for s in range(_lfFredDebugShardCount):
+            shardList = _lfFredDebugShards[s]['list']
+            first = shardList['anchorLink'].address
+            next = shardList['anchorLink']['link'][_lfFredDebugLink]['next']
+            if (next == 0):
+                continue
+            while (next != first):
+                FibreSupport.list.append(next)
+                next = next['link'][_lfFredDebugLink]['next']
         orig_thread = gdb.selected_thread()
         for thread in gdb.selected_inferior().threads():
             thread.switch()
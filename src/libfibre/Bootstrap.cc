@@ -17,9 +17,13 @@
 #include "libfibre/fibre.h"
 
 #include <atomic>
+#include <cctype>     // see _lfCpuTopology
 #include <csignal>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <list>
+#include <dirent.h>   // see _lfCpuTopology
 #include <cxxabi.h>   // see _lfAbort
 #include <execinfo.h> // see _lfAbort
 
@@ -29,11 +33,18 @@ WorkerLock*              _lfDebugOutputLock = (WorkerLock*)_lfDebugOutputLockMem
 size_t                   _lfPagesize = 0;
 
 #if TESTING_ENABLE_DEBUGGING
-static char              _lfFredDebugLockMemory[sizeof(WorkerLock)];
-WorkerLock*              _lfFredDebugLock = (WorkerLock*)_lfFredDebugLockMemory; // Fibre.h
-static char              _lfFredDebugListMemory[sizeof(FredList<FredDebugLink>)];
-FredList<FredDebugLink>* _lfFredDebugList = (FredList<FredDebugLink>*)_lfFredDebugListMemory; // Fibre.h
+static char              _lfFredDebugShardMemory[sizeof(FredDebugShard) * FredDebugShards] __caligned;
+FredDebugShard*          _lfFredDebugShards = (FredDebugShard*)_lfFredDebugShardMemory; // Fibre.h
+size_t                   _lfFredDebugShardCount = FredDebugShards;
 size_t                   _lfFredDebugLink = FredDebugLink;
+static size_t            _lfFredDebugShardNext = 0;
+
+// shard index assigned round-robin per thread at first fibre creation
+size_t _lfFredDebugShard() { // Fibre.h
+  static thread_local size_t shard = 0; // 0: not yet assigned
+  if slowpath(!shard) shard = __atomic_add_fetch(&_lfFredDebugShardNext, 1, __ATOMIC_RELAXED);
+  return shard % FredDebugShards;
+}
 #endif
 
 // ******************** BOOTSTRAP *************************
@@ -69,8 +80,7 @@ EventScope* FibreInit(size_t pollerCount, size_t workerCount) {
   _lfPagesize = sysconf(_SC_PAGESIZE);
   new (_lfDebugOutputLock) WorkerLock;
 #if TESTING_ENABLE_DEBUGGING
-  new (_lfFredDebugLock) WorkerLock;
-  new (_lfFredDebugListMemory) FredList<FredDebugLink>;
+  for (size_t i = 0; i < FredDebugShards; i += 1) new (&_lfFredDebugShards[i]) FredDebugShard;
 #endif
   FredStats::StatsReset();
   SYSCALL(atexit(_lfPrintStats));
@@ -96,13 +106,71 @@ EventScope* FibreInit(size_t pollerCount, size_t workerCount) {
     int cnt = atoi(env);
     if (cnt > 0) workerCount = cnt;
   }
+  size_t stackLocal = StackCache::DefaultLocalLimit;
+  env = getenv("FibreStackCache");
+  if (env) {
+    int cnt = atoi(env);
+    if (cnt >= 0) stackLocal = cnt;
+  }
+  size_t stackGlobal = StackCache::DefaultGlobalLimit;
+  env = getenv("FibreStackCacheGlobal");
+  if (env) {
+    int cnt = atoi(env);
+    if (cnt >= 0) stackGlobal = cnt;
+  }
+  size_t stackReclaim = 0;
+  bool stackDontneed = false;
+  env = getenv("FibreStackReclaim");
+  if (env) {
+    char* end;
+    long long mark = strtoll(env, &end, 10);
+    if (mark > 0) stackReclaim = mark;
+    stackDontneed = (end[0] == 'd' || end[0] == 'D');
+  }
+  size_t stackArena = 0;
+  env = getenv("FibreStackArena");
+  if (env) {
+    int cnt = atoi(env);
+    if (cnt > 0) stackArena = cnt;
+  }
+  StackCache::init(stackLocal, stackGlobal, stackReclaim, stackDontneed, stackArena);
   std::list<size_t> cpulist;
   env = getenv("FibreCpuSet");
   if (env) {
     parselist(env, cpulist);
     if (cpulist.size() > workerCount) workerCount = cpulist.size();
   }
-  return EventScope::bootstrap(cpulist, pollerCount, workerCount);
+#if TESTING_WORKER_IO_URING
+  env = getenv("FibreUringSqpoll");
+  if (env) {
+    int idle = atoi(env);
+    if (idle > 0) {
+      std::list<size_t> sqcpus;
+      env = getenv("FibreUringSqpollCpu");
+      if (env) parselist(env, sqcpus);
+      IOUring::setupSQPoll(idle, sqcpus, getenv("FibreUringSqpollShared") != nullptr);
+    }
+  }
+#endif
+#if TESTING_PREEMPTION
+  _lfPreemptionInit();
+#endif
+  EventScope* es = EventScope::bootstrap(cpulist, pollerCount, workerCount);
+#if TESTING_PREEMPTION
+  env = getenv("FibrePreemption");
+  if (env) {
+    long long ns = atoll(env);
+    if (ns > 0) Context::CurrCluster().setPreemption(ns);
+  }
+#endif
+#if TESTING_IO_URING_FILES
+  env = getenv("FibreUringFileDepth");
+  if (env) {
+    int depth = atoi(env);
+    if (depth > 0) es->setFileDepth(depth);
+  }
+#endif
+  return es;
 }
 
 pid_t FibreFork() {
@@ -117,6 +185,45 @@ pid_t FibreFork() {
 
 // ******************** GLOBAL HELPERS ********************
 
+// read first number in sysfs file: id or lowest cpu in cpu list
+static size_t sysfsFirst(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) return limit<size_t>();
+  size_t val;
+  int ret = fscanf(f, "%zu", &val);
+  fclose(f);
+  return ret == 1 ? val : limit<size_t>();
+}
+
+// topology ids for victim selection, see BaseProcessor::StealLevel
+void _lfCpuTopology(size_t cpu, size_t ids[BaseProcessor::StealRemote]) {
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/topology/thread_siblings_list", cpu);
+  ids[BaseProcessor::StealCore] = sysfsFirst(path);
+  ids[BaseProcessor::StealCache] = limit<size_t>();
+  size_t llc = 0;
+  for (size_t idx = 0; ; idx += 1) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/cache/index%zu/level", cpu, idx);
+    size_t level = sysfsFirst(path);
+    if (level == limit<size_t>()) break;
+    if (level < llc) continue;
+    llc = level;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/cache/index%zu/shared_cpu_list", cpu, idx);
+    ids[BaseProcessor::StealCache] = sysfsFirst(path);
+  }
+  ids[BaseProcessor::StealNode] = limit<size_t>();
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu", cpu);
+  DIR* dir = opendir(path);
+  if (!dir) return;
+  while (dirent* ent = readdir(dir)) {
+    if (strncmp(ent->d_name, "node", 4) == 0 && isdigit(ent->d_name[4])) {
+      ids[BaseProcessor::StealNode] = atoi(ent->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+}
+
 int _SysErrno() {
   return errno;
 }
@@ -15,8 +15,19 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 #include "libfibre/Cluster.h"
+#include "libfibre/EventScope.h"
 
 #include <limits.h> // PTHREAD_STACK_MIN
+#if TESTING_PREEMPTION
+#include <cstring>
+#include <link.h>     // dl_iterate_phdr
+#include <ucontext.h>
+#include <sys/syscall.h>
+#endif
+
+#if TESTING_WORKER_IO_URING
+IOUring::SQPoll IOUring::sqpoll; // zero-initialized
+#endif
 
 namespace Context {
 
@@ -27,6 +38,7 @@ static thread_local EventScope*    currScope    = nullptr;
 
 Fred*          CurrFred()       { RASSERT0(currFred);    return  currFred; }
 BaseProcessor& CurrProcessor()  { RASSERT0(currProc);    return *currProc; }
+BaseProcessor* CurrProcessorOrNull() { return currProc; }
 Cluster&       CurrCluster()    { RASSERT0(currCluster); return *currCluster; }
 EventScope&    CurrEventScope() { RASSERT0(currScope);   return *currScope; }
 
@@ -44,8 +56,163 @@ void installFake(EventScope* es, _friend<BaseThreadPoller>) {
   currScope = es;
 }
 
+#if TESTING_PREEMPTION
+static thread_local volatile size_t preemptDepth = 0;
+
+// signal handler on same thread: plain load/store suffices
+static inline void addPreemptDepth(ssize_t d) {
+  __atomic_store_n(&preemptDepth, __atomic_load_n(&preemptDepth, __ATOMIC_RELAXED) + d, __ATOMIC_RELAXED);
+}
+#endif
+
 } // namespace Context
 
+#if TESTING_PREEMPTION
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+static const int PreemptSignal = SIGURG;
+
+// out-of-line runtime code: the build renames .text of runtime objects (see
+// src/Makefile), which works for libfibre.a and libfibre.so alike - inline
+// runtime code in application text is bracketed explicitly instead
+extern const char __start_fibre_text[] __attribute__((weak));
+extern const char __stop_fibre_text[] __attribute__((weak));
+
+// text segments of system libraries that must not be interrupted by preemption (locks)
+static const size_t PreemptRangeMax = 32;
+static uintptr_t    preemptRange[PreemptRangeMax][2];
+static size_t       preemptRangeCount = 0;
+
+static int preemptRangeAdd(struct dl_phdr_info* info, size_t, void*) {
+  static const char* libs[] = { "libc.so", "libc-", "libpthread", "ld-linux", "libstdc++", "libgcc_s" };
+  const char* name = strrchr(info->dlpi_name, '/');
+  name = name ? name + 1 : info->dlpi_name;
+  bool match = false;
+  for (const char* lib : libs) match = match || strncmp(name, lib, strlen(lib)) == 0;
+  if (!match) return 0;
+  for (size_t i = 0; i < info->dlpi_phnum && preemptRangeCount < PreemptRangeMax; i += 1) {
+    const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+    if (ph.p_type != PT_LOAD || !(ph.p_flags & PF_X)) continue;
+    preemptRange[preemptRangeCount][0] = info->dlpi_addr + ph.p_vaddr;
+    preemptRange[preemptRangeCount][1] = info->dlpi_addr + ph.p_vaddr + ph.p_memsz;
+    preemptRangeCount += 1;
+  }
+  return 0;
+}
+
+static bool preemptSafeCode(ptr_t uctx) {
+#if defined(__x86_64__)
+  uintptr_t pc = ((ucontext_t*)uctx)->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+  uintptr_t pc = ((ucontext_t*)uctx)->uc_mcontext.pc;
+#else
+#error unsupported architecture: only __x86_64__ or __aarch64__ supported at this time
+#endif
+  if (pc >= uintptr_t(__start_fibre_text) && pc < uintptr_t(__stop_fibre_text)) return false;
+  for (size_t i = 0; i < preemptRangeCount; i += 1) {
+    if (pc >= preemptRange[i][0] && pc < preemptRange[i][1]) return false;
+  }
+  return true;
+}
+
+void _lfPreemptionInit() {
+  dl_iterate_phdr(preemptRangeAdd, nullptr);
+  struct sigaction sa;
+  sa.sa_sigaction = Cluster::preemptHandler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_NODEFER; // handler might not return for a while
+  sigemptyset(&sa.sa_mask);
+  SYSCALL(sigaction(PreemptSignal, &sa, 0));
+}
+
+void RuntimeDisablePreemption() { Context::addPreemptDepth(1); }
+
+void RuntimeEnablePreemption() {
+  RASSERT0(Context::preemptDepth);
+  Context::addPreemptDepth(-1);
+  Cluster::Worker* w = reinterpret_cast<Cluster::Worker*>(Context::currProc);
+  if (w && w->preemptPending == Context::currFred && Cluster::preemptible(*w)) Cluster::preemptNow(*w, Context::currFred);
+}
+
+bool RuntimePreemptionEnabled() { return Context::preemptDepth == 0; }
+
+void RuntimeLockPreemption() {
+  if (Context::currProc) Context::currFred->lockPreemption();
+}
+
+void RuntimeUnlockPreemption() {
+  if (!Context::currProc || !Context::currFred->unlockPreemption()) return;
+  Cluster::Worker* w = reinterpret_cast<Cluster::Worker*>(Context::currProc);
+  if (w->preemptPending == Context::currFred && Cluster::preemptible(*w)) Cluster::preemptNow(*w, Context::currFred);
+}
+
+// safe point: outside of runtime brackets, no worker lock held, not idle loop
+bool Cluster::preemptible(Worker& w) {
+  Fred* f = Context::currFred;
+  return Context::preemptDepth == 0 && f != w.getIdleLoop() && f->preemptible();
+}
+
+void Cluster::preemptNow(Worker& w, Fred* f) {
+  Context::addPreemptDepth(1);
+  if (__atomic_exchange_n(&w.preemptPending, nullptr, __ATOMIC_SEQ_CST) == f) {
+    int err = errno;
+    w.preemptTick = nullptr;
+    Fred::preempt();                      // fred is pinned -> continues on same worker
+    RASSERT0(Context::currProc == &w);
+    errno = err;
+  }
+  Context::addPreemptDepth(-1);
+}
+
+// fred is preempted, if it is seen at two consecutive signals, i.e., after
+// running for (about) one time slice - otherwise retry at next safe point
+void Cluster::preemptHandler(int, siginfo_t*, ptr_t uctx) {
+  Worker* w = reinterpret_cast<Worker*>(Context::currProc);
+  if (!w) return;
+  Fred* f = Context::currFred;
+  if (w->preemptTick != f) {
+    w->preemptTick = f;
+    w->preemptPending = nullptr;
+    return;
+  }
+  w->preemptPending = f;
+  if (preemptible(*w) && preemptSafeCode(uctx)) preemptNow(*w, f);
+}
+
+// called by worker thread: cpu-time clock, so timer does not fire while worker is halted
+void Cluster::setupPreemption(Worker& w) {
+  struct sigevent sev;
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = PreemptSignal;
+  sev.sigev_notify_thread_id = syscall(SYS_gettid);
+  SYSCALL(timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &w.preemptTimer));
+  ScopedLock<WorkerLock> sl(ringLock);
+  w.hasPreemptTimer = true;
+  if (preemptNS) armPreemption(w);
+}
+
+// caller holds ringLock
+void Cluster::armPreemption(Worker& w) {
+  if (!w.hasPreemptTimer) return;
+  struct itimerspec its;
+  its.it_value.tv_sec = its.it_interval.tv_sec = preemptNS / 1000000000;
+  its.it_value.tv_nsec = its.it_interval.tv_nsec = preemptNS % 1000000000;
+  SYSCALL(timer_settime(w.preemptTimer, 0, &its, nullptr));
+}
+
+void Cluster::setPreemption(size_t ns) {
+  ScopedLock<WorkerLock> sl(ringLock);
+  preemptNS = ns;
+  BaseProcessor* p = placeProc;
+  for (size_t i = 0; i < ringCount; i += 1) {
+    armPreemption(*reinterpret_cast<Worker*>(p));
+    p = ProcessorRing::next(*p);
+  }
+}
+#endif
+
 #if TESTING_WORKER_IO_URING || TESTING_WORKER_POLLER
 bool RuntimeWorkerPoll(BaseProcessor& proc) {
   return Cluster::pollWorker(proc);
@@ -59,6 +226,11 @@ void RuntimeWorkerSuspend(BaseProcessor& proc) {
 void RuntimeWorkerResume(BaseProcessor& proc) {
   Cluster::resumeWorker(proc);
 }
+#if TESTING_IO_URING_ADAPTIVE
+void RuntimeWorkerFlush(BaseProcessor& proc) {
+  Cluster::flushWorker(proc);
+}
+#endif
 #endif
 
 inline void Cluster::setupWorker(Fibre* fibre, Worker* worker) {
@@ -72,10 +244,16 @@ inline void Cluster::setupWorker(Fibre* fibre, Worker* worker) {
   Context::install(fibre, worker, this, &scope, _friend<Cluster>());
 #if TESTING_WORKER_IO_URING
   worker->iouring = new IOUring(worker, "W-IOUring ");
+#if TESTING_IO_URING_FIXED
+  scope.addUring(*worker->iouring, _friend<Cluster>());
+#endif
 #endif
 #if TESTING_WORKER_POLLER
   worker->workerPoller = new WorkerPoller(scope, worker, "W-Poller  ");
 #endif
+#if TESTING_PREEMPTION
+  setupPreemption(*worker);
+#endif
 }
 
 void Cluster::initDummy(ptr_t) {}
@@ -123,11 +301,18 @@ void Cluster::postFork(cptr_t parent, _friend<EventScope> fes) {
 #if TESTING_WORKER_IO_URING
   CurrWorker().iouring->~IOUring();
   new (CurrWorker().iouring) IOUring(&CurrWorker(), "W-IOUring ");
+#if TESTING_IO_URING_FIXED
+  scope.addUring(*CurrWorker().iouring, _friend<Cluster>());
+#endif
 #endif
 #if TESTING_WORKER_POLLER
   CurrWorker().workerPoller->~WorkerPoller();
   new (CurrWorker().workerPoller) WorkerPoller(Context::CurrEventScope(), &CurrWorker(), "W-Poller  ");
 #endif
+#if TESTING_PREEMPTION
+  CurrWorker().hasPreemptTimer = false; // timers are not inherited
+  setupPreemption(CurrWorker());
+#endif
 }
 
 Fibre* Cluster::registerWorker(_friend<EventScope>) {
@@ -171,7 +356,11 @@ void Cluster::pause() {
   ringLock.acquire();
   stats->pause.count(ringCount);
   for (BaseProcessor* proc = placeProc;;) {
+#if TESTING_ELASTIC_WORKERS
+    if (proc != &Context::CurrProcessor() && !proc->isRetired()) { // retired: already stopped
+#else
     if (proc != &Context::CurrProcessor()) {
+#endif
       Fibre* f = new Fibre(*proc, _friend<Cluster>());
       f->setAffinity(true);
       f->setName("s:Pause");
@@ -182,12 +371,16 @@ void Cluster::pause() {
     proc = ProcessorRing::next(*proc);
     if (proc == placeProc) break;
   }
+#if !TESTING_ELASTIC_WORKERS
   RASSERT(pauseFibres.size() == ringCount-1, pauseFibres.size(), ringCount-1);
-  for (size_t p = 1; p < ringCount; p += 1) pauseConfirmSem.P();
+#endif
+  for (size_t p = 0; p < pauseFibres.size(); p += 1) pauseConfirmSem.P();
+  quiescePlacement(true);
 }
 
 void Cluster::resume() {
-  for (size_t p = 1; p < ringCount; p += 1) pauseSem.V();
+  quiescePlacement(false);
+  for (size_t p = 0; p < pauseFibres.size(); p += 1) pauseSem.V();
   for (auto f : pauseFibres) delete f;
   pauseFibres.clear();
   ringLock.release();
@@ -197,3 +390,75 @@ void Cluster::pauseOperation(Cluster* cl) {
   cl->pauseConfirmSem.V();
   cl->pauseSem.P();
 }
+
+#if TESTING_ELASTIC_WORKERS
+void Cluster::setElastic(size_t min, size_t max, size_t periodUS) {
+  RASSERT(min <= max && (min > 0 || max == 0), min, max);
+  elasticPeriodUS = periodUS;
+  elasticMin = min;
+  elasticMax = max;
+  ScopedLock<WorkerLock> sl(ringLock);
+  if (max && !elasticFibre) {
+    elasticFibre = new Fibre(*this);
+    elasticFibre->setName("s:Elastic");
+    elasticFibre->run(elasticLoop, this);
+  }
+}
+
+// controller fibre sleeps for at most one period before it notices 'elasticStop'
+void Cluster::stopElastic() {
+  if (!elasticFibre) return;
+  elasticStop = true;
+  delete elasticFibre;
+  elasticFibre = nullptr;
+}
+
+long long Cluster::idleTotal(long long now) {
+  ScopedLock<WorkerLock> sl(ringLock);
+  long long total = 0;
+  BaseProcessor* p = placeProc;
+  for (size_t i = 0; i < ringCount; i += 1) {
+    total += p->getIdleNS(now);
+    p = ProcessorRing::next(*p);
+  }
+  return total;
+}
+
+// one adjustment per period: idle share of active workers, then backlog
+void Cluster::elasticStep(size_t idle) {
+  size_t active = activeProcessorCount();
+  size_t ready = 0;
+  {
+    ScopedLock<WorkerLock> sl(ringLock);
+    BaseProcessor* p = placeProc;
+    for (size_t i = 0; i < ringCount; i += 1) {
+      ready += p->getReadyLength();
+      p = ProcessorRing::next(*p);
+    }
+  }
+  stats->elastic.count(active);
+  if (active > elasticMax || (active > elasticMin && idle > ElasticRetireIdle)) {
+    requestRetire();
+  } else if (active < elasticMin || (active < elasticMax && idle < ElasticAddIdle && ready >= active)) {
+    if (!reactivateProcessor()) addWorker();
+  }
+}
+
+// idle: spinning and parked time of workers, including periods in progress
+void Cluster::elasticLoop(Cluster* cl) {
+  Time prev = Runtime::Timer::now();
+  long long idleNS = cl->idleTotal(prev.toNS());
+  for (;;) {
+    Fibre::usleep(cl->elasticPeriodUS);
+    if (cl->elasticStop) return;
+    Time now = Runtime::Timer::now();
+    long long i = cl->idleTotal(now.toNS());
+    long long span = (now - prev).toNS() * cl->activeProcessorCount();
+    size_t idle = span > 0 && i > idleNS ? (i - idleNS) * 100 / span : 0;
+    if (idle > 100) idle = 100;
+    idleNS = i;
+    prev = now;
+    if (cl->elasticMax) cl->elasticStep(idle);
+  }
+}
+#endif
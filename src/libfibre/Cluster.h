@@ -30,6 +30,11 @@
 #include <csignal>  // sigaltstack
 #endif
 
+#if TESTING_PREEMPTION
+#include <csignal>  // siginfo_t, timer_t
+extern void _lfPreemptionInit(); // Cluster.cc
+#endif
+
 /**
 A Cluster object provides a scheduling scope and uses processors (pthreads)
 to execute fibres.  It also manages I/O pollers and provides a
@@ -63,10 +68,18 @@ class Cluster : public Scheduler {
 #if TESTING_WORKER_POLLER
     WorkerPoller* workerPoller = nullptr;
 #endif
+#if TESTING_PREEMPTION
+    timer_t        preemptTimer;               // thread cpu-time timer
+    bool           hasPreemptTimer = false;    // timer created
+    Fred* volatile preemptTick = nullptr;      // fred seen at last timer signal
+    Fred* volatile preemptPending = nullptr;   // fred to preempt at next safe point
+#endif
+    StackCache    stackCache;
     Worker(Cluster& c) : BaseProcessor(c) {
       c.Scheduler::addProcessor(*this);
     }
     void setIdleLoop(Fibre* f) { BaseProcessor::idleFred = f; }
+    Fred* getIdleLoop()        { return BaseProcessor::idleFred; }
     void runIdleLoop(Fibre* f) { BaseProcessor::idleLoop(f); }
     pthread_t getSysID()       { return sysThreadId; }
   };
@@ -94,6 +107,32 @@ class Cluster : public Scheduler {
     Fibre*   initFibre;
   };
 
+#if TESTING_PREEMPTION
+  volatile size_t preemptNS = 0;      // time slice, 0 = preemption disabled
+  void         setupPreemption(Worker&);
+  void         armPreemption(Worker&);
+  static bool  preemptible(Worker&);
+  static void  preemptNow(Worker&, Fred*);
+  static void  preemptHandler(int, siginfo_t*, ptr_t);
+  friend void  _lfPreemptionInit();
+  friend void  RuntimeEnablePreemption();
+  friend void  RuntimeUnlockPreemption();
+#endif
+
+#if TESTING_ELASTIC_WORKERS
+  static const size_t ElasticRetireIdle = 50; // idle percentage above which a worker retires
+  static const size_t ElasticAddIdle    = 10; // idle percentage below which a worker is added
+  volatile size_t elasticMin = 0;
+  volatile size_t elasticMax = 0;             // 0 = elastic mode disabled
+  volatile size_t elasticPeriodUS;
+  volatile bool   elasticStop = false;
+  Fibre*          elasticFibre = nullptr;
+  long long       idleTotal(long long now);
+  void            elasticStep(size_t idle);
+  static void     elasticLoop(Cluster*);
+  void            stopElastic();
+#endif
+
   inline void  setupWorker(Fibre*, Worker*);
   static void  initDummy(ptr_t);
   static void  fibreHelper(Worker*);
@@ -109,6 +148,9 @@ public:
   void startPolling(_friend<EventScope>) { start(); }
 
   ~Cluster() {
+#if TESTING_ELASTIC_WORKERS
+    stopElastic();
+#endif
     // TODO: wait until regular fibres have left, then delete processors?
     delete [] iPollVec;
     delete [] oPollVec;
@@ -117,6 +159,10 @@ public:
   void preFork(_friend<EventScope>);
   void postFork(cptr_t parent, _friend<EventScope>);
 
+  static StackCache& getStackCache(BaseProcessor& proc, _friend<StackCache>) {
+    return reinterpret_cast<Worker&>(proc).stackCache;
+  }
+
 #if TESTING_WORKER_IO_URING
   static IOUring& getWorkerUring() {
     return *CurrWorker().iouring;
@@ -125,6 +171,11 @@ public:
   static bool pollWorker(BaseProcessor& proc) {
     return reinterpret_cast<Worker&>(proc).iouring->poll(_friend<Cluster>());
   }
+#if TESTING_IO_URING_ADAPTIVE
+  static void flushWorker(BaseProcessor& proc) {
+    reinterpret_cast<Worker&>(proc).iouring->flush(_friend<Cluster>());
+  }
+#endif
   static bool trySuspendWorker(BaseProcessor& proc) {
     return reinterpret_cast<Worker&>(proc).iouring->trySuspend(_friend<Cluster>());
   }
@@ -175,6 +226,34 @@ public:
     return ringCount;
   }
 
+  /** Obtain workers' processors, same order as getWorkerSysIDs(). */
+  size_t getWorkerProcessors(BaseProcessor** procs, size_t cnt = 0) {
+    ScopedLock<WorkerLock> sl(ringLock);
+    BaseProcessor* p = placeProc;
+    for (size_t i = 0; i < cnt && i < ringCount; i += 1) {
+      procs[i] = p;
+      p = ProcessorRing::next(*p);
+    }
+    return ringCount;
+  }
+
+#if TESTING_PREEMPTION
+  /** Set time slice (thread cpu time, nanoseconds) for timer-signal
+      preemption of long-running fibres, 0 disables preemption. */
+  void setPreemption(size_t ns);
+  size_t getPreemption() const { return preemptNS; }
+#endif
+
+#if TESTING_ELASTIC_WORKERS
+  static const size_t DefaultElasticPeriodUS = 100000;
+
+  /** Elastic mode: every period, retire a worker when workers are mostly
+      idle or add/reactivate one when they are busy and freds are queued,
+      keeping the number of active workers within [min, max].
+      'max' = 0 disables elastic mode. */
+  void setElastic(size_t min, size_t max, size_t periodUS = DefaultElasticPeriodUS);
+#endif
+
   /** Get individual access to pollers. */
   PollerType&  getInputPoller(size_t hint) { return iPollVec[hint % iPollCount]; }
   PollerType& getOutputPoller(size_t hint) { return oPollVec[hint % oPollCount]; }
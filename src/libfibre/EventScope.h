@@ -21,15 +21,21 @@
 
 #include "libfibre/Fibre.h"
 #include "libfibre/Cluster.h"
+#if TESTING_COROUTINES
+#include "runtime/Task.h"
+#endif
 
 #include <fcntl.h>        // O_NONBLOCK
 #include <limits.h>       // PTHREAD_STACK_MIN
 #include <unistd.h>       // various syscalls
+#include <stdlib.h>       // posix_memalign
 #include <sys/resource.h> // getrlimit
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
 
+extern void _lfCpuTopology(size_t cpu, size_t ids[BaseProcessor::StealRemote]); // Bootstrap.cc
+
 #ifdef __GNUC__
 #define restrict __restrict__
 #else
@@ -42,18 +48,74 @@
  partitioned kernel file descriptor tables on Linux.
 */
 class EventScope {
-  // A vector for FDs works well here in principle, because POSIX guarantees lowest-numbered FDs:
+  // POSIX guarantees lowest-numbered FDs, so a table indexed by FD works well:
   // http://pubs.opengroup.org/onlinepubs/9699919799/functions/V2_chap02.html#tag_15_14
-  // A fixed-size array based on 'getrlimit' is somewhat brute-force, but simple and fast.
+  // The table is sized by 'getrlimit', but split into pages that are only
+  // allocated when an FD in their range is first used.
   struct SyncFD {
     Poller::SyncSem sync[2];
     BasePoller*     poller[2];
     bool            blocking;
     bool            useUring;
-    SyncFD() : poller{nullptr,nullptr}, blocking(false), useUring(false) {}
-  } *fdSyncVector;
+#if TESTING_COROUTINES
+    Task* volatile  waiter[2];    // suspended coroutine, see FibreCoroutine.h
+#endif
+#if TESTING_IO_URING_MULTISHOT
+    UringMultishot* volatile multishot; // armed accept/recv, see IOUring.h
+#endif
+#if TESTING_IO_URING_FIXED
+    bool            fixed;        // registered with worker rings, see IOUring.h
+    uint8_t         uringOps;     // counts up to FixedHotOps, see uringFor()
+#endif
+#if TESTING_IO_URING_FILES
+    bool            file;         // regular file opened via openat(), I/O via worker ring
+#endif
+    SyncFD() : poller{nullptr,nullptr}, blocking(false), useUring(false)
+#if TESTING_COROUTINES
+    , waiter{nullptr,nullptr}
+#endif
+#if TESTING_IO_URING_MULTISHOT
+    , multishot(nullptr)
+#endif
+#if TESTING_IO_URING_FIXED
+    , fixed(false), uringOps(0)
+#endif
+#if TESTING_IO_URING_FILES
+    , file(false)
+#endif
+    {}
+  } __caligned;
 
+  static const int SyncPageBits = 8;
+  static const int SyncPageSize = 1 << SyncPageBits;
+
+  SyncFD* volatile* fdSyncPages;
   int fdCount;
+  int fdPageCount;
+
+  SyncFD* allocSyncPage(int p) {
+    ptr_t mem;
+    SYSCALL(posix_memalign(&mem, alignof(SyncFD), sizeof(SyncFD) * SyncPageSize));
+    SyncFD* page = (SyncFD*)mem;
+    for (int i = 0; i < SyncPageSize; i += 1) new (&page[i]) SyncFD;
+    SyncFD* expected = nullptr;
+    if (__atomic_compare_exchange_n(&fdSyncPages[p], &expected, page, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return page;
+    freeSyncPage(page);                                                     // lost race
+    return expected;
+  }
+
+  static void freeSyncPage(SyncFD* page) {
+    for (int i = 0; i < SyncPageSize; i += 1) page[i].~SyncFD();
+    free(page);
+  }
+
+  SyncFD* getSyncPage(int p) const { return __atomic_load_n(&fdSyncPages[p], __ATOMIC_ACQUIRE); }
+
+  SyncFD& fdSync(int fd) {
+    SyncFD* page = getSyncPage(fd >> SyncPageBits);
+    if slowpath(!page) page = allocSyncPage(fd >> SyncPageBits);
+    return page[fd & (SyncPageSize - 1)];
+  }
 
   EventScope*   parentScope;
   MasterPoller* masterPoller; // runs without cluster
@@ -63,6 +125,13 @@ class EventScope {
   // therefore, all file operations are executed on dedicated processor(s)
   Cluster*      diskCluster;
 
+#if TESTING_IO_URING_FILES
+  // with io_uring, file operations are submitted from the current worker instead
+  // the semaphore bounds the number of file operations in flight per event scope
+  static const size_t FileDepthDefault = 1024;
+  FredBenaphore<FredSemaphore> fileDepth;
+#endif
+
   // main fibre, cluster
   Fibre*        mainFibre;
   Cluster*      mainCluster;
@@ -72,21 +141,37 @@ class EventScope {
 
   FredStats::EventScopeStats* stats;
 
+#if TESTING_IO_URING_FIXED
+  static const uint8_t FixedHotOps = 16; // ring operations before fd is registered
+  UringBufferPool fixedPool;  // registered with all worker rings
+  IOUring*        uringList;  // worker rings, for unregistering files
+  WorkerLock      uringLock;  // also serializes file (un)registration
+#endif
+
   // TODO: not available until cluster deletion implemented
   ~EventScope() {
     delete mainFibre;
     delete mainCluster;
     masterPoller->terminate(_friend<EventScope>());
     delete masterPoller;
-    delete[] fdSyncVector;
+    for (int p = 0; p < fdPageCount; p += 1) if (getSyncPage(p)) freeSyncPage(getSyncPage(p));
+    delete[] fdSyncPages;
   }
 
   static void cloneInternal(EventScope* This) {
     This->initSync();
     RASSERT0(This->parentScope);
-    for (int f = 0; f < This->fdCount; f += 1) {
-      This->fdSyncVector[f].blocking = This->parentScope->fdSyncVector[f].blocking;
-      This->fdSyncVector[f].useUring = This->parentScope->fdSyncVector[f].useUring;
+    for (int p = 0; p < This->fdPageCount; p += 1) {
+      SyncFD* page = This->parentScope->getSyncPage(p);
+      if (!page) continue;
+      for (int i = 0; i < SyncPageSize; i += 1) {
+        SyncFD& fdsync = This->fdSync((p << SyncPageBits) + i);
+        fdsync.blocking = page[i].blocking;
+        fdsync.useUring = page[i].useUring;
+#if TESTING_IO_URING_FILES
+        fdsync.file = page[i].file;
+#endif
+      }
     }
 #if defined(__linux__)
     SYSCALL(unshare(CLONE_FILES));
@@ -96,7 +181,14 @@ class EventScope {
     This->start();
   }
 
-  EventScope(size_t pollerCount, EventScope* ps = nullptr) : parentScope(ps), timerQueue(this), diskCluster(nullptr) {
+  EventScope(size_t pollerCount, EventScope* ps = nullptr) : parentScope(ps), timerQueue(this), diskCluster(nullptr)
+#if TESTING_IO_URING_FILES
+  , fileDepth(FileDepthDefault)
+#endif
+#if TESTING_IO_URING_FIXED
+  , uringList(nullptr)
+#endif
+  {
     RASSERT0(pollerCount > 0);
     stats = new FredStats::EventScopeStats(this, nullptr);
     mainCluster = new Cluster(*this, pollerCount, _friend<EventScope>());   // create main cluster
@@ -108,7 +200,8 @@ class EventScope {
     rl.rlim_max = rl.rlim_cur;                                              // firm up current FD limit
     SYSCALL(setrlimit(RLIMIT_NOFILE, &rl));                                 // and install maximum
     fdCount = rl.rlim_max + MasterPoller::extraTimerFD;                     // add fake timer fd, if necessary
-    fdSyncVector = new SyncFD[fdCount];                                     // create vector of R/W sync points
+    fdPageCount = (fdCount + SyncPageSize - 1) >> SyncPageBits;
+    fdSyncPages = new SyncFD* volatile[fdPageCount]();                      // R/W sync points, allocated by page
   }
 
   void start() {
@@ -118,13 +211,39 @@ class EventScope {
 
   void cleanupFD(int fd) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    SyncFD& fdsync = fdSyncVector[fd];
+    SyncFD* page = getSyncPage(fd >> SyncPageBits);
+    if (!page) return;                                                      // fd never used
+    SyncFD& fdsync = page[fd & (SyncPageSize - 1)];
     fdsync.sync[false].reset();
     fdsync.sync[true].reset();
     fdsync.poller[false] = nullptr;
     fdsync.poller[true] = nullptr;
     fdsync.blocking = false;
+#if TESTING_IO_URING_FIXED
+    bool wasUring = fdsync.useUring;
+#endif
     fdsync.useUring = false;
+#if TESTING_IO_URING_FILES
+    fdsync.file = false;
+#endif
+#if TESTING_COROUTINES
+    fdsync.waiter[false] = nullptr;
+    fdsync.waiter[true] = nullptr;
+#endif
+#if TESTING_IO_URING_MULTISHOT
+    UringMultishot* ms = __atomic_exchange_n(&fdsync.multishot, nullptr, __ATOMIC_ACQ_REL);
+    if (ms) ms->close();
+#endif
+#if TESTING_IO_URING_FIXED
+    if (wasUring) {                                                         // before fd can be reused
+      ScopedLock<WorkerLock> sl(uringLock);                                 // see fixFD()
+      if (fdsync.fixed) {
+        for (IOUring* r = uringList; r; r = r->next(_friend<EventScope>())) r->unregisterFile(fd, _friend<EventScope>());
+      }
+      fdsync.fixed = false;
+      fdsync.uringOps = 0;
+    }
+#endif
   }
 
   template<bool Input, bool Cluster>
@@ -179,14 +298,14 @@ class EventScope {
     } else {
       if (tryIO<Input>(ret, iofunc, fd, a...)) return ret;
     }
-    BasePoller*& poller = fdSyncVector[fd].poller[Input];
+    BasePoller*& poller = fdSync(fd).poller[Input];
     if (!poller) {
       poller = &getPoller<Input,Accept>(fd);
       poller->setupFD(fd, Poller::Create, direction, variant);
     } else if (variant == Poller::Oneshot) {
       poller->setupFD(fd, Poller::Modify, direction, variant);
     }
-    Poller::SyncSem& sync = fdSyncVector[fd].sync[Input];
+    Poller::SyncSem& sync = fdSync(fd).sync[Input];
     for (;;) {
       if (variant == Poller::Level) sync.wait(); else sync.P();
       if (tryIO<Input>(ret, iofunc, fd, a...)) return ret;
@@ -197,7 +316,7 @@ class EventScope {
   }
 
   int checkAsyncCompletion(int fd) {
-    SyncFD& fdsync = fdSyncVector[fd];
+    SyncFD& fdsync = fdSync(fd);
     fdsync.poller[false] = &getPoller<false,false>(fd);
     fdsync.poller[false]->setupFD(fd, Poller::Create, Poller::Output, Poller::Oneshot); // register immediately
     fdsync.sync[false].P();                                                             // wait for completion
@@ -225,6 +344,8 @@ public:
     if (workerCount > 1) es->mainCluster->addWorkers(workerCount - 1);
     pthread_t* tids = new pthread_t[workerCount];
     es->mainCluster->getWorkerSysIDs(tids, workerCount);
+    BaseProcessor** procs = new BaseProcessor*[workerCount];
+    es->mainCluster->getWorkerProcessors(procs, workerCount);
     cpu_set_t onecpu;
     CPU_ZERO(&onecpu);
     auto it = cpulist.begin();
@@ -232,7 +353,12 @@ public:
       CPU_SET(*it, &onecpu);
       SYSCALL(pthread_setaffinity_np(tids[i], sizeof(cpu_set_t), &onecpu));
       CPU_CLR(*it, &onecpu);
+      size_t ids[BaseProcessor::StealRemote];
+      _lfCpuTopology(*it, ids);
+      procs[i]->setTopology(ids, _friend<EventScope>());
     }
+    for (size_t i = 0; i < workerCount; i += 1) procs[i]->setStealVictims(procs, workerCount, _friend<EventScope>());
+    delete [] procs;
     delete [] tids;
     es->initSync();
     es->start();
@@ -266,10 +392,16 @@ public:
     RASSERT0(diskCluster == nullptr);
     mainCluster->preFork(_friend<EventScope>());
     for (int f = 0; f < fdCount; f += 1) {
-      RASSERT(fdSyncVector[f].sync[false].getValue() >= 0, f);
-      RASSERT(fdSyncVector[f].sync[true].getValue() >= 0, f);
-      RASSERT(fdSyncVector[f].poller[false] == 0, f);
-      RASSERT(fdSyncVector[f].poller[true] == 0, f);
+      SyncFD* page = getSyncPage(f >> SyncPageBits);
+      if (!page) {
+        f += SyncPageSize - 1;
+        continue;
+      }
+      SyncFD& fdsync = page[f & (SyncPageSize - 1)];
+      RASSERT(fdsync.sync[false].getValue() >= 0, f);
+      RASSERT(fdsync.sync[true].getValue() >= 0, f);
+      RASSERT(fdsync.poller[false] == 0, f);
+      RASSERT(fdsync.poller[true] == 0, f);
     }
   }
 
@@ -280,10 +412,22 @@ public:
     delete masterPoller; // FreeBSD does not copy kqueue across fork()
 #endif
     masterPoller = new MasterPoller(*this, fdCount, _friend<EventScope>()); // start master poller & timer handling
+#if TESTING_IO_URING_FIXED
+    uringList = nullptr;                                                    // single worker ring re-added
+#endif
     mainCluster->postFork(this, _friend<EventScope>());
     mainCluster->startPolling(_friend<EventScope>());
   }
 
+#if TESTING_IO_URING_FIXED
+  void addUring(IOUring& ring, _friend<Cluster>) {
+    ring.registerBuffers(fixedPool, _friend<EventScope>());
+    ScopedLock<WorkerLock> sl(uringLock);
+    ring.next(_friend<EventScope>()) = uringList;
+    uringList = &ring;
+  }
+#endif
+
   /** Wait for the main routine of a cloned event scope. */
   void join() { mainFibre->join(); }
 
@@ -295,6 +439,14 @@ public:
     return *diskCluster;
   }
 
+#if TESTING_IO_URING_FILES
+  /** Set maximum number of file operations in flight. Call before any file I/O. */
+  void setFileDepth(size_t depth) {
+    RASSERT0(depth > 0);
+    fileDepth.reset(depth);
+  }
+#endif
+
   /** Set event-scope-local data. */
   void setClientData(void* cd) { clientData = cd; }
 
@@ -307,21 +459,70 @@ public:
 
   bool tryblock(int fd, _friend<MasterPoller>) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    return fdSyncVector[fd].sync[true].tryP();
+    return fdSync(fd).sync[true].tryP();
   }
 
 #if TESTING_WORKER_POLLER
   bool tryblock(int fd, _friend<WorkerPoller>) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    return fdSyncVector[fd].sync[true].tryP();
+    return fdSync(fd).sync[true].tryP();
   }
 #endif
 
   template<bool Input, bool Enqueue = true>
   Fred* unblock(int fd, _friend<BasePoller>) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    return fdSyncVector[fd].sync[Input].V<Enqueue>();
+#if TESTING_COROUTINES
+    // oneshot registration: event belongs to waiting coroutine, if any
+    Task* t = __atomic_exchange_n(&fdSync(fd).waiter[Input], nullptr, __ATOMIC_ACQUIRE);
+    if (t) {
+      t->run();
+      return nullptr;
+    }
+#endif
+    Fred* f = fdSync(fd).sync[Input].V<false>();
+    if (Enqueue && f) f->resume<false,true>(); // run next: I/O data likely hot in cache
+    return f;
+  }
+
+#if TESTING_COROUTINES
+  /** Coroutine I/O on 'fd' might have to wait for readiness. */
+  bool coBlocking(int fd) {
+    RASSERT0(fd >= 0 && fd < fdCount);
+    RASSERT(!fdSync(fd).useUring, fd); // coroutine I/O uses event polling only
+    return fdSync(fd).blocking;
+  }
+
+  template<bool Input, typename T, class... Args>
+  bool coTryIO(T& ret, T (*iofunc)(int, Args...), int fd, Args... a) {
+    return tryIO<Input>(ret, iofunc, fd, a...);
+  }
+
+  /** Arm oneshot notification for 'fd'; 'w' is run by the poller. */
+  template<bool Input>
+  void coWait(int fd, Task& w) {
+    static const Poller::Direction direction = Input ? Poller::Input : Poller::Output;
+    RASSERT0(fd >= 0 && fd < fdCount);
+    SyncFD& fdsync = fdSync(fd);
+    RASSERT(!fdsync.waiter[Input], fd);     // one waiting coroutine per direction
+    __atomic_store_n(&fdsync.waiter[Input], &w, __ATOMIC_RELEASE); // before arming
+    BasePoller*& poller = fdsync.poller[Input];
+    if (!poller) {
+      poller = &getPoller<Input,true>(fd);
+      poller->setupFD(fd, Poller::Create, direction, Poller::Oneshot);
+    } else {
+      poller->setupFD(fd, Poller::Modify, direction, Poller::Oneshot);
+    }
+  }
+
+  /** Set up connection 'ret', accepted by coroutine on 'fd', see accept4(). */
+  void coAccepted(int fd, int ret, int flags) {
+    RASSERT0(ret >= 0 && ret < fdCount);
+    fdSync(ret).blocking = !(flags & SOCK_NONBLOCK);
+    fdSync(ret).useUring = fdSync(fd).useUring;
+    stats->srvconn.count();
   }
+#endif
 
   void registerPollFD(int fd, _friend<PollerFibre>) {
     RASSERT0(fd >= 0 && fd < fdCount);
@@ -331,16 +532,20 @@ public:
   void blockPollFD(int fd, _friend<PollerFibre>) {
     RASSERT0(fd >= 0 && fd < fdCount);
     masterPoller->setupFD(fd, Poller::Modify, Poller::Input, Poller::Oneshot);
-    fdSyncVector[fd].sync[true].P();
+    fdSync(fd).sync[true].P();
   }
 
   void unblockPollFD(int fd, _friend<PollerFibre>) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    fdSyncVector[fd].sync[true].V();
+    fdSync(fd).sync[true].V();
   }
 
   template<typename T, class... Args>
   T directIO(T (*diskfunc)(Args...), Args... a) {
+#if TESTING_IO_URING_FILES
+    T ret;
+    if (fileDirect(ret, diskfunc, a...)) return ret;
+#endif
     RASSERT0(diskCluster);
     BaseProcessor& proc = Fibre::migrate(*diskCluster);
     int result = diskfunc(a...);
@@ -351,14 +556,14 @@ public:
   template<typename T, class... Args>
   T syncInput( T (*readfunc)(int, Args...), int fd, Args... a) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return readfunc(fd, a...);
+    if (!fdSync(fd).blocking) return readfunc(fd, a...);
     return blockingInput(readfunc, fd, a...);
   }
 
   template<typename T, class... Args>
   T syncOutput( T (*writefunc)(int, Args...), int fd, Args... a) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return writefunc(fd, a...);
+    if (!fdSync(fd).blocking) return writefunc(fd, a...);
     return blockingOutput(writefunc, fd, a...);
   }
 
@@ -369,14 +574,14 @@ public:
     int ret = ::epoll_wait(epfd, events, maxevents, 0);
     if (ret != 0 || timeout == 0) return ret;
     stats->fails.count();
-    BasePoller*& poller = fdSyncVector[epfd].poller[true];
+    BasePoller*& poller = fdSync(epfd).poller[true];
     if (!poller) {
       poller = &getPoller<true,false>(epfd);
       poller->setupFD(epfd, Poller::Create, Poller::Input, Poller::Oneshot);
     } else {
       poller->setupFD(epfd, Poller::Modify, Poller::Input, Poller::Oneshot);
     }
-    Poller::SyncSem& sync = fdSyncVector[epfd].sync[true];
+    Poller::SyncSem& sync = fdSync(epfd).sync[true];
     Time absTimeout;
     if (timeout > 0) absTimeout = Runtime::Timer::now() + Time::fromMS(timeout);
     for (;;) {
@@ -394,18 +599,120 @@ public:
   int socket(int domain, int type, int protocol, bool useUring) {
     int ret = ::socket(domain, type | (useUring ? 0 : SOCK_NONBLOCK), protocol);
     if (ret < 0) return ret;
-    fdSyncVector[ret].blocking = !(type & SOCK_NONBLOCK);
-    fdSyncVector[ret].useUring = useUring;
+    fdSync(ret).blocking = !(type & SOCK_NONBLOCK);
+    fdSync(ret).useUring = useUring;
     return ret;
   }
 
 #if TESTING_WORKER_IO_URING
-  inline bool uring(int fd) { return fdSyncVector[fd].useUring; }
+  inline bool uring(int fd) { return fdSync(fd).useUring; }
+
+  // register hot fds only: each registration is a system call per worker ring
+  IOUring& uringFor(int fd) {
+    IOUring& ring = Cluster::getWorkerUring();
+#if TESTING_IO_URING_FIXED
+    if (ring.canRegister(fd)) {
+      SyncFD& fdsync = fdSync(fd);
+      if (fdsync.fixed) fixFD(ring, fd);                                    // lazily on other workers
+      else if (fdsync.uringOps < FixedHotOps && ++fdsync.uringOps == FixedHotOps) fixFD(ring, fd);
+    }
+#else
+    (void)fd;
+#endif
+    return ring;
+  }
+#endif
+
+#if TESTING_IO_URING_FIXED
+  // serialized with unregistering in cleanupFD(): a closing fd is not registered again
+  void fixFD(IOUring& ring, int fd) {
+    ScopedLock<WorkerLock> sl(uringLock);
+    SyncFD& fdsync = fdSync(fd);
+    if (fdsync.useUring && ring.registerFile(fd, _friend<EventScope>())) fdsync.fixed = true;
+  }
+
+  bool useFixed(int fd, cptr_t buf, size_t nbyte) {
+    RASSERT0(fd >= 0 && fd < fdCount);
+    if (!fdSync(fd).blocking || !uring(fd) || !fixedPool.contains(buf, nbyte)) return false;
+#if TESTING_IO_URING_MULTISHOT
+    if (fdSync(fd).multishot) return false;                                 // keep stream order
+#endif
+    return Cluster::getWorkerUring().hasBufferPool();
+  }
+#endif
+
+#if TESTING_IO_URING_FILES
+  template<class... Args>
+  int fileIO( void (*prepfunc)(struct io_uring_sqe *sqe, Args...), Args... a) {
+    fileDepth.P();                                                          // queue depth control
+    int ret = Cluster::getWorkerUring().syncIO(prepfunc, a...);
+    fileDepth.V();
+    return ret;
+  }
+
+  inline bool file(int fd) { return fdSync(fd).file; }
+
+  // directIO() calls with an io_uring equivalent - everything else is migrated
+  template<typename T, class... Args>
+  bool fileDirect(T&, T (*)(Args...), Args...) { return false; }
+
+  bool fileDirect(ssize_t& ret, ssize_t (*diskfunc)(int, void*, size_t), int fd, void *buf, size_t nbyte) {
+    if (diskfunc != ::read) return false;
+    ret = fileIO(io_uring_prep_read, fd, buf, (unsigned)nbyte, (UringOffsetType)-1);
+    return true;
+  }
+
+  bool fileDirect(ssize_t& ret, ssize_t (*diskfunc)(int, const void*, size_t), int fd, const void *buf, size_t nbyte) {
+    if (diskfunc != ::write) return false;
+    ret = fileIO(io_uring_prep_write, fd, buf, (unsigned)nbyte, (UringOffsetType)-1);
+    return true;
+  }
+
+  bool fileDirect(ssize_t& ret, ssize_t (*diskfunc)(int, void*, size_t, off_t), int fd, void *buf, size_t nbyte, off_t offset) {
+    if (diskfunc != ::pread) return false;
+    ret = fileIO(io_uring_prep_read, fd, buf, (unsigned)nbyte, (UringOffsetType)offset);
+    return true;
+  }
+
+  bool fileDirect(ssize_t& ret, ssize_t (*diskfunc)(int, const void*, size_t, off_t), int fd, const void *buf, size_t nbyte, off_t offset) {
+    if (diskfunc != ::pwrite) return false;
+    ret = fileIO(io_uring_prep_write, fd, buf, (unsigned)nbyte, (UringOffsetType)offset);
+    return true;
+  }
+
+  bool fileDirect(int& ret, int (*diskfunc)(int), int fd) {
+    if (diskfunc != ::fsync && diskfunc != ::fdatasync) return false;
+    ret = fsync(fd, diskfunc == ::fdatasync);
+    return true;
+  }
+#endif
+
+#if TESTING_IO_URING_MULTISHOT
+  UringMultishot& multishot(int fd, bool acceptor) {
+    UringMultishot* volatile& ms = fdSync(fd).multishot;
+    UringMultishot* curr = __atomic_load_n(&ms, __ATOMIC_ACQUIRE);
+    if fastpath(curr) return *curr;
+    UringMultishot* nms = new UringMultishot(acceptor);
+    if (__atomic_compare_exchange_n(&ms, &curr, nms, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return *nms;
+    delete nms;                                                             // lost race
+    return *curr;
+  }
+
+  // input other than plain recv on fd with multishot recv: disarm and serve queued data first
+  bool multishotInput(ssize_t& ret, int fd, const struct iovec* iov, int cnt, int flags = 0) {
+    UringMultishot* ms = __atomic_load_n(&fdSync(fd).multishot, __ATOMIC_ACQUIRE);
+    return ms && ms->input(iov, cnt, flags & MSG_PEEK, ret);
+  }
+
+  bool multishotInput(ssize_t& ret, int fd, void* buf, size_t nbyte, int flags = 0) {
+    struct iovec iov = { buf, nbyte };
+    return multishotInput(ret, fd, &iov, 1, flags);
+  }
 #endif
 
   int bind(int fd, const sockaddr *addr, socklen_t addrlen) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::bind(fd, addr, addrlen);
+    if (!fdSync(fd).blocking) return ::bind(fd, addr, addrlen);
 #if TESTING_WORKER_IO_URING
     if (uring(fd)) return ::bind(fd, addr, addrlen);
 #endif
@@ -423,9 +730,9 @@ public:
 
   int connect(int fd, const sockaddr *addr, socklen_t addrlen) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::connect(fd, addr, addrlen);
+    if (!fdSync(fd).blocking) return ::connect(fd, addr, addrlen);
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_connect, fd, addr, addrlen);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_connect, fd, addr, addrlen);
 #endif
     int ret = ::connect(fd, addr, addrlen);
     if (ret < 0) {
@@ -445,17 +752,21 @@ public:
     int ret;
 #if TESTING_WORKER_IO_URING
     if (uring(fd)) {
-      ret = fdSyncVector[fd].blocking
-          ? Cluster::getWorkerUring().syncIO(io_uring_prep_accept, fd, addr, addrlen, flags)
+      ret = fdSync(fd).blocking
+#if TESTING_IO_URING_MULTISHOT
+          ? multishot(fd, true).accept(uringFor(fd), fd, addr, addrlen, flags)
+#else
+          ? uringFor(fd).syncIO(io_uring_prep_accept, fd, addr, addrlen, flags)
+#endif
           : ::accept4(fd, addr, addrlen, flags);
     } else
 #endif
-    ret = fdSyncVector[fd].blocking
+    ret = fdSync(fd).blocking
         ? syncIO<true,true>(::accept4, fd, addr, addrlen, flags | SOCK_NONBLOCK)
         : ::accept4(fd, addr, addrlen, flags | SOCK_NONBLOCK);
     if (ret < 0) return ret;
-    fdSyncVector[ret].blocking = !(flags & SOCK_NONBLOCK);
-    fdSyncVector[ret].useUring = fdSyncVector[fd].useUring;
+    fdSync(ret).blocking = !(flags & SOCK_NONBLOCK);
+    fdSync(ret).useUring = fdSync(fd).useUring;
     stats->srvconn.count();
     return ret;
   }
@@ -463,26 +774,29 @@ public:
   int dup(int fd) {
     int ret = ::dup(fd);
     if (ret < 0) return ret;
-    fdSyncVector[ret].blocking = fdSyncVector[fd].blocking;
-    fdSyncVector[ret].useUring = fdSyncVector[fd].useUring;
+    fdSync(ret).blocking = fdSync(fd).blocking;
+    fdSync(ret).useUring = fdSync(fd).useUring;
+#if TESTING_IO_URING_FILES
+    fdSync(ret).file = fdSync(fd).file;
+#endif
     return ret;
   }
 
   int pipe2(int pipefd[2], int flags, bool useUring) {
     int ret = ::pipe2(pipefd, flags | (useUring ? 0 : O_NONBLOCK));
     if (ret < 0) return ret;
-    fdSyncVector[pipefd[0]].blocking = !(flags & O_NONBLOCK);
-    fdSyncVector[pipefd[0]].useUring = useUring;
-    fdSyncVector[pipefd[1]].blocking = !(flags & O_NONBLOCK);
-    fdSyncVector[pipefd[1]].useUring = useUring;
+    fdSync(pipefd[0]).blocking = !(flags & O_NONBLOCK);
+    fdSync(pipefd[0]).useUring = useUring;
+    fdSync(pipefd[1]).blocking = !(flags & O_NONBLOCK);
+    fdSync(pipefd[1]).useUring = useUring;
     return ret;
   }
 
   int fcntl(int fd, int cmd, int flags) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    int ret = ::fcntl(fd, cmd, flags | (fdSyncVector[fd].useUring ? 0 : O_NONBLOCK));
+    int ret = ::fcntl(fd, cmd, flags | (fdSync(fd).useUring ? 0 : O_NONBLOCK));
     if (ret < 0) return ret;
-    fdSyncVector[fd].blocking = !(flags & O_NONBLOCK);
+    fdSync(fd).blocking = !(flags & O_NONBLOCK);
     return ret;
   }
 
@@ -491,90 +805,162 @@ public:
     return ::close(fd);
   }
 
+#if TESTING_IO_URING_FILES
+  int openat(int dirfd, const char *path, int flags, mode_t mode) {
+    int ret = fileIO(io_uring_prep_openat, dirfd, path, flags, mode);
+    if (ret < 0) return ret;
+    RASSERT0(ret < fdCount);
+    fdSync(ret).file = true;
+    return ret;
+  }
+
+  int fsync(int fd, bool datasync) {
+    return fileIO(io_uring_prep_fsync, fd, datasync ? (unsigned)IORING_FSYNC_DATASYNC : 0u);
+  }
+
+  int statx(int dirfd, const char *path, int flags, unsigned int mask, struct statx *statxbuf) {
+    return fileIO(io_uring_prep_statx, dirfd, path, flags, mask, statxbuf);
+  }
+#endif
+
   int read(int fd, void *buf, size_t nbyte) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::read(fd, buf, nbyte);
+#if TESTING_IO_URING_FILES
+    if (file(fd)) return fileIO(io_uring_prep_read, fd, buf, (unsigned)nbyte, (UringOffsetType)-1);
+#endif
+    if (!fdSync(fd).blocking) return ::read(fd, buf, nbyte);
+#if TESTING_IO_URING_MULTISHOT
+    if (fdSync(fd).multishot && nbyte > 0) return multishot(fd, false).recv(uringFor(fd), fd, buf, nbyte);
+#endif
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_read, fd, buf, (unsigned)nbyte, (UringOffsetType)0);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_read, fd, buf, (unsigned)nbyte, (UringOffsetType)0);
 #endif
     return blockingInput(::read, fd, buf, nbyte);
   }
 
+#if TESTING_IO_URING_FIXED
+  ptr_t allocFixed() { return fixedPool.acquire(); }
+  void freeFixed(ptr_t buf) { fixedPool.release(buf); }
+
+  int readFixed(int fd, void *buf, size_t nbyte) {
+    if (!useFixed(fd, buf, nbyte)) return read(fd, buf, nbyte);
+    return uringFor(fd).syncIO(io_uring_prep_read_fixed, fd, buf, (unsigned)nbyte, (UringOffsetType)0, 0);
+  }
+
+  int writeFixed(int fd, const void *buf, size_t nbyte) {
+    if (!useFixed(fd, buf, nbyte)) return write(fd, buf, nbyte);
+    return uringFor(fd).syncIO(io_uring_prep_write_fixed, fd, buf, (unsigned)nbyte, (UringOffsetType)0, 0);
+  }
+#endif
+
   int pread(int fd, void *buf, size_t nbyte, off_t offset) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::pread(fd, buf, nbyte, offset);
+#if TESTING_IO_URING_FILES
+    if (file(fd)) return fileIO(io_uring_prep_read, fd, buf, (unsigned)nbyte, (UringOffsetType)offset);
+#endif
+    if (!fdSync(fd).blocking) return ::pread(fd, buf, nbyte, offset);
+#if TESTING_IO_URING_MULTISHOT
+    ssize_t ret;
+    if (multishotInput(ret, fd, buf, nbyte)) return ret;
+#endif
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_read, fd, buf, (unsigned)nbyte, (UringOffsetType)offset);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_read, fd, buf, (unsigned)nbyte, (UringOffsetType)offset);
 #endif
     return blockingInput(::pread, fd, buf, nbyte, offset);
   }
 
   int readv(int fd, const struct iovec *iovecs, int nr_vecs) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::readv(fd, iovecs, nr_vecs);
+#if TESTING_IO_URING_FILES
+    if (file(fd)) return fileIO(io_uring_prep_readv, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)-1);
+#endif
+    if (!fdSync(fd).blocking) return ::readv(fd, iovecs, nr_vecs);
+#if TESTING_IO_URING_MULTISHOT
+    ssize_t ret;
+    if (multishotInput(ret, fd, iovecs, nr_vecs)) return ret;
+#endif
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_readv, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)0);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_readv, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)0);
 #endif
     return blockingInput(::readv, fd, iovecs, nr_vecs);
   }
 
   int preadv(int fd, const struct iovec *iovecs, int nr_vecs, off_t offset) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::preadv(fd, iovecs, nr_vecs, offset);
+#if TESTING_IO_URING_FILES
+    if (file(fd)) return fileIO(io_uring_prep_readv, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)offset);
+#endif
+    if (!fdSync(fd).blocking) return ::preadv(fd, iovecs, nr_vecs, offset);
+#if TESTING_IO_URING_MULTISHOT
+    ssize_t ret;
+    if (multishotInput(ret, fd, iovecs, nr_vecs)) return ret;
+#endif
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_readv, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)offset);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_readv, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)offset);
 #endif
     return blockingInput(::preadv, fd, iovecs, nr_vecs, offset);
   }
 
   int write(int fd, const void *buf, size_t nbyte) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::write(fd, buf, nbyte);
+#if TESTING_IO_URING_FILES
+    if (file(fd)) return fileIO(io_uring_prep_write, fd, buf, (unsigned)nbyte, (UringOffsetType)-1);
+#endif
+    if (!fdSync(fd).blocking) return ::write(fd, buf, nbyte);
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_write, fd, buf, (unsigned)nbyte, (UringOffsetType)0);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_write, fd, buf, (unsigned)nbyte, (UringOffsetType)0);
 #endif
     return blockingOutput(::write, fd, buf, nbyte);
   }
 
   int pwrite(int fd, const void *buf, size_t nbyte, off_t offset) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::pwrite(fd, buf, nbyte, offset);
+#if TESTING_IO_URING_FILES
+    if (file(fd)) return fileIO(io_uring_prep_write, fd, buf, (unsigned)nbyte, (UringOffsetType)offset);
+#endif
+    if (!fdSync(fd).blocking) return ::pwrite(fd, buf, nbyte, offset);
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_write, fd, buf, (unsigned)nbyte, (UringOffsetType)offset);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_write, fd, buf, (unsigned)nbyte, (UringOffsetType)offset);
 #endif
     return blockingOutput(::pwrite, fd, buf, nbyte, offset);
   }
 
   int writev(int fd, const struct iovec *iovecs, int nr_vecs) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::writev(fd, iovecs, nr_vecs);
+#if TESTING_IO_URING_FILES
+    if (file(fd)) return fileIO(io_uring_prep_writev, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)-1);
+#endif
+    if (!fdSync(fd).blocking) return ::writev(fd, iovecs, nr_vecs);
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_writev, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)0);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_writev, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)0);
 #endif
     return blockingOutput(::writev, fd, iovecs, nr_vecs);
   }
 
   int pwritev(int fd, const struct iovec *iovecs, int nr_vecs, off_t offset) {
     RASSERT0(fd >= 0 && fd < fdCount);
-    if (!fdSyncVector[fd].blocking) return ::pwritev(fd, iovecs, nr_vecs, offset);
+#if TESTING_IO_URING_FILES
+    if (file(fd)) return fileIO(io_uring_prep_writev, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)offset);
+#endif
+    if (!fdSync(fd).blocking) return ::pwritev(fd, iovecs, nr_vecs, offset);
 #if TESTING_WORKER_IO_URING
-    if (uring(fd)) return Cluster::getWorkerUring().syncIO(io_uring_prep_writev, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)offset);
+    if (uring(fd)) return uringFor(fd).syncIO(io_uring_prep_writev, fd, iovecs, (unsigned)nr_vecs, (UringOffsetType)offset);
 #endif
     return blockingOutput(::pwritev, fd, iovecs, nr_vecs, offset);
   }
 
   ssize_t sendmsg(int socket, const struct msghdr *message, int flags) {
     RASSERT0(socket >= 0 && socket < fdCount);
-    if (!fdSyncVector[socket].blocking) return ::sendmsg(socket, message, flags);
+    if (!fdSync(socket).blocking) return ::sendmsg(socket, message, flags);
 #if TESTING_WORKER_IO_URING
-    if (uring(socket)) return Cluster::getWorkerUring().syncIO(io_uring_prep_sendmsg, socket, message, (unsigned)flags);
+    if (uring(socket)) return uringFor(socket).syncIO(io_uring_prep_sendmsg, socket, message, (unsigned)flags);
 #endif
     return blockingOutput(::sendmsg, socket, message, flags);
   }
 
   ssize_t sendto(int socket, const void *message, size_t length, int flags, const struct sockaddr *dest_addr, socklen_t dest_len) {
     RASSERT0(socket >= 0 && socket < fdCount);
-    if (!fdSyncVector[socket].blocking) return ::sendto(socket, message, length, flags, dest_addr, dest_len);
+    if (!fdSync(socket).blocking) return ::sendto(socket, message, length, flags, dest_addr, dest_len);
 #if TESTING_WORKER_IO_URING
     if (uring(socket)) {
       struct iovec iov = { .iov_base = (void*)message, .iov_len = length };
@@ -588,25 +974,34 @@ public:
 
   ssize_t send(int socket, const void *buffer, size_t length, int flags) {
     RASSERT0(socket >= 0 && socket < fdCount);
-    if (!fdSyncVector[socket].blocking) return ::send(socket, buffer, length, flags);
+    if (!fdSync(socket).blocking) return ::send(socket, buffer, length, flags);
 #if TESTING_WORKER_IO_URING
-    if (uring(socket)) return Cluster::getWorkerUring().syncIO(io_uring_prep_send, socket, buffer, length, flags);
+    if (uring(socket)) return uringFor(socket).syncIO(io_uring_prep_send, socket, buffer, length, flags);
 #endif
     return blockingOutput(::send, socket, buffer, length, flags);
   }
 
   ssize_t recvmsg(int socket, struct msghdr *message, int flags) {
     RASSERT0(socket >= 0 && socket < fdCount);
-    if (!fdSyncVector[socket].blocking) return ::recvmsg(socket, message, flags);
+    if (!fdSync(socket).blocking) return ::recvmsg(socket, message, flags);
+#if TESTING_IO_URING_MULTISHOT
+    ssize_t ret;
+    if (multishotInput(ret, socket, message->msg_iov, (int)message->msg_iovlen, flags)) {
+      message->msg_namelen = 0;                                             // connected stream socket
+      message->msg_controllen = 0;
+      message->msg_flags = 0;
+      return ret;
+    }
+#endif
 #if TESTING_WORKER_IO_URING
-    if (uring(socket)) return Cluster::getWorkerUring().syncIO(io_uring_prep_recvmsg, socket, message, (unsigned)flags);
+    if (uring(socket)) return uringFor(socket).syncIO(io_uring_prep_recvmsg, socket, message, (unsigned)flags);
 #endif
     return blockingInput(::recvmsg, socket, message, flags);
   }
 
   ssize_t recvfrom(int socket, void *restrict buffer, size_t length, int flags, struct sockaddr *restrict address, socklen_t *restrict address_len)  {
     RASSERT0(socket >= 0 && socket < fdCount);
-    if (!fdSyncVector[socket].blocking) return ::recvfrom(socket, buffer, length, flags, address, address_len);
+    if (!fdSync(socket).blocking) return ::recvfrom(socket, buffer, length, flags, address, address_len);
 #if TESTING_WORKER_IO_URING
     if (uring(socket)) {
       struct iovec iov = { .iov_base = buffer, .iov_len = length };
@@ -622,9 +1017,14 @@ public:
 
   ssize_t recv(int socket, void *buffer, size_t length, int flags) {
     RASSERT0(socket >= 0 && socket < fdCount);
-    if (!fdSyncVector[socket].blocking) return ::recv(socket, buffer, length, flags);
+    if (!fdSync(socket).blocking) return ::recv(socket, buffer, length, flags);
+#if TESTING_IO_URING_MULTISHOT
+    if (uring(socket) && flags == 0 && length > 0) return multishot(socket, false).recv(uringFor(socket), socket, buffer, length);
+    ssize_t ret;
+    if (multishotInput(ret, socket, buffer, length, flags)) return ret;
+#endif
 #if TESTING_WORKER_IO_URING
-    if (uring(socket)) return Cluster::getWorkerUring().syncIO(io_uring_prep_recv, socket, buffer, length, flags);
+    if (uring(socket)) return uringFor(socket).syncIO(io_uring_prep_recv, socket, buffer, length, flags);
 #endif
     return blockingInput(::recv, socket, buffer, length, flags);
   }
@@ -642,7 +1042,8 @@ inline T lfOutput( T (*writefunc)(int, Args...), int fd, Args... a) {
   return Context::CurrEventScope().syncOutput(writefunc, fd, a...); // no yield before write
 }
 
-/** @brief Generic wrapper for I/O that cannot be polled. Fibre is migrated to disk cluster for execution. */
+/** @brief Generic wrapper for I/O that cannot be polled. Fibre is migrated to disk cluster for execution.
+    With TESTING_IO_URING_FILES, read/write/pread/pwrite/fsync/fdatasync are submitted to the worker's io_uring instead. */
 template<typename T, class... Args>
 inline T lfDirectIO( T (*diskfunc)(int, Args...), int fd, Args... a) {
   return Context::CurrEventScope().directIO(diskfunc, fd, a...);
@@ -705,10 +1106,60 @@ static inline int lfFcntl(int fd, int cmd, int flags) {
   return Context::CurrEventScope().fcntl(fd, cmd, flags);
 }
 
+#if TESTING_IO_URING_FILES
+/** @brief Open regular file via io_uring. Subsequent I/O on the new file descriptor is submitted to the worker's io_uring.
+    With O_DIRECT, buffers, offsets, and lengths must be aligned to the logical block size. */
+static inline int lfOpenat(int dirfd, const char *path, int flags, mode_t mode = 0) {
+  return Context::CurrEventScope().openat(dirfd, path, flags, mode);
+}
+
+/** @brief Open regular file via io_uring, see lfOpenat(). */
+static inline int lfOpen(const char *path, int flags, mode_t mode = 0) {
+  return Context::CurrEventScope().openat(AT_FDCWD, path, flags, mode);
+}
+
+/** @brief Synchronize file with storage via io_uring. */
+static inline int lfFsync(int fd) {
+  return Context::CurrEventScope().fsync(fd, false);
+}
+
+/** @brief Synchronize file data with storage via io_uring. */
+static inline int lfFdatasync(int fd) {
+  return Context::CurrEventScope().fsync(fd, true);
+}
+
+/** @brief Get file status via io_uring. */
+static inline int lfStatx(int dirfd, const char *path, int flags, unsigned int mask, struct statx *statxbuf) {
+  return Context::CurrEventScope().statx(dirfd, path, flags, mask, statxbuf);
+}
+#endif
+
 static inline int lfRead(int fd, void *buf, size_t nbyte) {
   return Context::CurrEventScope().read(fd, buf, nbyte);
 }
 
+#if TESTING_IO_URING_FIXED
+/** @brief Get buffer of size UringBufferPool::Size from the fixed buffer pool. Returns nullptr if pool exhausted. */
+static inline void* lfFixedAlloc() {
+  return Context::CurrEventScope().allocFixed();
+}
+
+/** @brief Return buffer to the fixed buffer pool. */
+static inline void lfFixedFree(void* buf) {
+  Context::CurrEventScope().freeFixed(buf);
+}
+
+/** @brief Read into a buffer from lfFixedAlloc(). Same as lfRead() if fd is not a blocking uring fd. */
+static inline int lfReadFixed(int fd, void *buf, size_t nbyte) {
+  return Context::CurrEventScope().readFixed(fd, buf, nbyte);
+}
+
+/** @brief Write from a buffer from lfFixedAlloc(). Same as lfWrite() if fd is not a blocking uring fd. */
+static inline int lfWriteFixed(int fd, const void *buf, size_t nbyte) {
+  return Context::CurrEventScope().writeFixed(fd, buf, nbyte);
+}
+#endif
+
 static inline int lfPread(int fd, void *buf, size_t nbyte, off_t offset) {
   return Context::CurrEventScope().pread(fd, buf, nbyte, offset);
 }
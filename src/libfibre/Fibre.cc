@@ -17,10 +17,372 @@
 #include "libfibre/Cluster.h"
 #include "libfibre/Fibre.h"
 
-FastMutex FibreSpecific::mutex;
-Bitmap<FibreSpecific::FIBRE_KEYS_MAX> FibreSpecific::bitmap;
-std::vector<FibreSpecific::Destructor> FibreSpecific::destructors;
+#include <cerrno>
+#include <cstring>
+#if TESTING_STACK_PROFILE
+#include <map>
+#endif
+
+// constant-initialized: fibre_local objects register during static construction
+FibreLocalBase* volatile FibreLocalBase::list = nullptr;
+volatile size_t FibreLocalBase::reservedBytes = 0;
+
+FibreLocalBase::FibreLocalBase(size_t size, size_t align, Destructor d) : destructor(d) {
+  if (align > MaxAlign) RABORT("fibre_local alignment too large: ", align);
+  if (align < sizeof(mword)) align = sizeof(mword);
+  valueOffset = align_up(sizeof(mword), align);
+  size_t prev = __atomic_load_n(&reservedBytes, __ATOMIC_RELAXED);
+  size_t end;
+  do {
+    offset = align_up(prev, align);
+    end = offset + valueOffset + size;
+  } while (!__atomic_compare_exchange_n(&reservedBytes, &prev, end, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  next = __atomic_load_n(&list, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&list, &next, this, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// most recent registration first: reverse order of construction
+void FibreLocalBase::destroyAll(Fibre& f) {
+  for (FibreLocalBase* l = __atomic_load_n(&list, __ATOMIC_ACQUIRE); l; l = l->next) {
+    mword* init = (mword*)f.localFind(l->offset, _friend<FibreLocalBase>());
+    if (init && *init) {
+      l->destructor(*l, (char*)init + l->valueOffset);
+      *init = 0;
+    }
+  }
+}
+
+volatile uintptr_t FibreKey::freeList = 0;
+
+FibreKey* FibreKey::create(KeyDestructor d) {
+  uintptr_t prev = __atomic_load_n(&freeList, __ATOMIC_ACQUIRE);
+  for (;;) {
+    FibreKey* k = (FibreKey*)(prev & bitmask<uintptr_t>(TagShift));
+    if (!k) return new FibreKey(d);
+    // key objects are never freed: reading 'nextFree' of a stale key is safe
+    uintptr_t next = uintptr_t(k->nextFree) | ((prev >> TagShift) + 1) << TagShift;
+    if (__atomic_compare_exchange_n(&freeList, &prev, next, false, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)) {
+      k->keyDestructor = d;
+      return k;
+    }
+  }
+}
+
+// new generation: values stored under this key become invisible
+void FibreKey::remove() {
+  keyDestructor = nullptr;
+  __atomic_add_fetch(&gen, 1, __ATOMIC_RELAXED);
+  uintptr_t prev = __atomic_load_n(&freeList, __ATOMIC_RELAXED);
+  do {
+    nextFree = (FibreKey*)(prev & bitmask<uintptr_t>(TagShift));
+  } while (!__atomic_compare_exchange_n(&freeList, &prev, uintptr_t(this) | ((prev >> TagShift) + 1) << TagShift, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+// pthread semantics: value reset before destructor is called
+void FibreKey::destroy(FibreLocalBase& b, ptr_t p) {
+  FibreKey& k = static_cast<FibreKey&>(b);
+  Value& v = *(Value*)p;
+  if (v.gen != k.gen || !v.value || !k.keyDestructor) return;
+  void* value = v.value;
+  v.value = nullptr;
+  k.keyDestructor(value);
+}
+
+// zero slots registered since the fibre's block was last extended; slots
+// registered after the block was sized go to heap blocks ('localOverflow')
+ptr_t Fibre::localExtend(size_t offset) {
+  size_t used = FibreLocalBase::reserved();
+  RASSERT(offset < used, offset, used);
+  if (!localBlock) {
+    RASSERT0(localHeap());
+    localSize = used;
+    SYSCALL(posix_memalign((void**)&localBlock, FibreLocalBase::MaxAlign, localSize));
+  }
+  if (offset < localSize) {
+    size_t end = used < localSize ? used : localSize;
+    memset(localBlock + localUsed, 0, end - localUsed);
+    localUsed = end;
+    return localBlock + offset;
+  }
+  ptr_t slot = localFind(offset);
+  if (slot) return slot;
+  LocalOverflow* o = new LocalOverflow;
+  o->base = localOverflow ? localOverflow->end : localSize;
+  o->end = used;
+  size_t len = o->base % FibreLocalBase::MaxAlign + o->end - o->base;
+  SYSCALL(posix_memalign((void**)&o->mem, FibreLocalBase::MaxAlign, len));
+  memset(o->mem, 0, len);
+  o->next = localOverflow;
+  localOverflow = o;
+  return o->slot(offset);
+}
 
 void Fibre::exit(ptr_t p) {
   throw (ExitException*)p;
 }
+
+Fibre* volatile Fibre::reapList = nullptr;
+
+// delete terminated fibres queued by destroy(), see detachDelete()
+void Fibre::reap() {
+  if (!__atomic_load_n(&reapList, __ATOMIC_RELAXED)) return;
+  Fibre* f = __atomic_exchange_n(&reapList, nullptr, __ATOMIC_ACQUIRE);
+  while (f) {
+    Fibre* next = f->reapLink;
+    delete f;
+    f = next;
+  }
+}
+
+#ifndef SPLIT_STACK
+// out of line, so that the allocation pairing is opaque to the compiler
+void* Fibre::operator new(size_t sz) {
+  return ::operator new(sz);
+}
+
+// object is destroyed, but its storage is intact until released here
+void Fibre::operator delete(void* p) {
+  if (!static_cast<Fibre*>(p)->stackColocated) { ::operator delete(p); return; }
+  vaddr top = colocateTop(vaddr(p));
+  StackCache::release(top - DefaultStackSize - DefaultStackGuard, DefaultStackSize, DefaultStackGuard);
+}
+#endif
+
+#if TESTING_STACKLESS_TASKS
+void FibreTask::spawn(Func f, ptr_t a, Scheduler& s) {
+  s.enqueueTask(*new FibreTask(f, a, s));
+}
+
+void FibreTask::invoke(Task& t) {
+  FibreTask* ft = static_cast<FibreTask*>(&t);
+  if (ft->func(ft->arg, false)) {
+    delete ft;
+  } else {
+    Fibre* f = Fibre::create(ft->scheduler);
+    f->setName("s:Task");
+    f->detachDelete();
+    f->run(promoted, ft);
+  }
+}
+
+void FibreTask::promoted(FibreTask* t) {
+  t->func(t->arg, true);
+  delete t;
+}
+#endif
+
+#if TESTING_STACK_PROFILE
+static const mword StackPaintWord = 0x5ca1ab1e5ca1ab1e;
+
+void Fibre::stackPaint(vaddr bottom, size_t size) {
+  mword* p = (mword*)bottom;
+  for (size_t i = 0; i < size / sizeof(mword); i += 1) p[i] = StackPaintWord;
+}
+
+// record deepest touched offset per fibre name; called from finalize() on the
+// fibre's own stack, since the final switch hook must not allocate or lock
+void Fibre::stackProfile() {
+  // scan before any allocation below deepens the stack
+  vaddr bottom = stackBottom + stackGuard;
+  vaddr top = stackTop();
+  mword* p = (mword*)bottom;
+  while (vaddr(p) < top && *p == StackPaintWord) p += 1;
+  // not destroyed at exit: stats are printed afterwards
+  static WorkerLock* lock = new WorkerLock;
+  static auto* profile = new std::map<std::string,FredStats::StackStats*>;
+  ScopedLock<WorkerLock> sl(*lock);
+  const std::string& key = name.empty() ? "-" : name;
+  auto it = profile->find(key);
+  if (it == profile->end()) {
+    it = profile->emplace(key, nullptr).first;
+    it->second = new FredStats::StackStats(&it->first, nullptr, it->first.c_str());
+  }
+  it->second->count(top - vaddr(p));
+}
+#endif
+
+size_t StackCache::localLimit  = StackCache::DefaultLocalLimit;
+size_t StackCache::globalLimit = StackCache::DefaultGlobalLimit;
+StackCache::List StackCache::global[Classes];
+size_t StackCache::reclaimMark = 0;
+size_t StackCache::arenaChunk = 0;
+StackCache::Arena StackCache::arena[Classes];
+static const mword StackCanaryWord = 0xdeadc0dedeadc0de;
+#ifdef MADV_FREE
+static int _lfStackAdvice = MADV_FREE;
+#else
+static int _lfStackAdvice = MADV_DONTNEED;
+#endif
+
+// global pool lock might be needed before static constructors, see Bootstrap.cc
+static char        _lfStackCacheLockMemory[sizeof(WorkerLock)];
+static WorkerLock* _lfStackCacheLock = (WorkerLock*)_lfStackCacheLockMemory;
+
+void StackCache::init(size_t l, size_t g, size_t r, bool dontneed, size_t a) {
+  new (_lfStackCacheLock) WorkerLock;
+  localLimit = l;
+  globalLimit = g;
+  reclaimMark = align_up(r, _lfPagesize);
+  if (dontneed) _lfStackAdvice = MADV_DONTNEED;
+  arenaChunk = a * ArenaPage;
+}
+
+size_t StackCache::sizeClass(size_t size, size_t guard) {
+  if (guard != Fibre::DefaultStackGuard) return Classes;
+  for (size_t c = 0; c < Classes; c += 1) {
+    if (size == Fibre::DefaultStackSize << c) return c;
+  }
+  return Classes;
+}
+
+// must be called with preemption disabled; null for non-worker threads
+StackCache::List* StackCache::localList(size_t c) {
+  BaseProcessor* proc = Context::CurrProcessorOrNull();
+  if (!proc || localLimit == 0) return nullptr;
+  return &Cluster::getStackCache(*proc, _friend<StackCache>()).local[c];
+}
+
+// stacks are painted at creation when profiling, otherwise the marker is reset to 0
+#if TESTING_STACK_PROFILE
+static const mword StackUnusedWord = StackPaintWord;
+#else
+static const mword StackUnusedWord = 0;
+#endif
+
+// false negative: a fibre that leaves the unused value at the marker keeps
+// the pages below resident until a later release finds the marker changed
+void StackCache::reclaim(vaddr top, size_t size) {
+  if (reclaimMark == 0 || reclaimMark >= size) return;
+  mword* marker = (mword*)(top - reclaimMark) - 1;
+  if (*marker == StackUnusedWord) return; // no use below watermark since last reclaim
+  // marker page stays resident: resetting the marker must not re-fault a released page
+  vaddr bottom = top - size;
+  size_t len = align_down(vaddr(marker), vaddr(_lfPagesize)) - bottom;
+  *marker = StackUnusedWord;
+  if (len == 0) return;
+  if (madvise(ptr_t(bottom), len, _lfStackAdvice) < 0) {
+    RASSERT(errno == EINVAL && _lfStackAdvice != MADV_DONTNEED, errno);
+    _lfStackAdvice = MADV_DONTNEED; // MADV_FREE not supported by kernel
+    SYSCALL(madvise(ptr_t(bottom), len, _lfStackAdvice));
+  }
+  BaseProcessor* proc = Context::CurrProcessorOrNull();
+  if (proc) proc->stats->stackReclaim.count(len);
+}
+
+vaddr StackCache::arenaAlloc(size_t c, size_t size, size_t guard) {
+  Arena& a = arena[c];
+  uintptr_t prev = __atomic_load_n(&a.top, __ATOMIC_ACQUIRE);
+  for (;;) {
+    Link* l = (Link*)(prev & bitmask<uintptr_t>(TagShift));
+    if (!l) break;
+    // arena memory is never unmapped: reading 'next' of a stale slot is safe
+    uintptr_t next = uintptr_t(l->next) | ((prev >> TagShift) + 1) << TagShift;
+    if (__atomic_compare_exchange_n(&a.top, &prev, next, false, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)) {
+      return vaddr(l + 1) - size - guard;
+    }
+  }
+  // carve new slot from current chunk, map new chunk if needed
+  size_t slot = size + guard;
+  vaddr s;
+  {
+    ScopedLock<WorkerLock> sl(*_lfStackCacheLock);
+    if (a.next + slot > a.limit) {
+      size_t len = arenaChunk + ArenaPage;
+      ptr_t ptr = mmap(0, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+      RASSERT0(ptr != MAP_FAILED);
+      vaddr start = align_up(vaddr(ptr), ArenaPage);
+      if (start > vaddr(ptr)) SYSCALL(munmap(ptr, start - vaddr(ptr)));
+      if (vaddr(ptr) + len > start + arenaChunk) SYSCALL(munmap(ptr_t(start + arenaChunk), vaddr(ptr) + len - start - arenaChunk));
+#ifdef MADV_HUGEPAGE
+      madvise(ptr_t(start), arenaChunk, MADV_HUGEPAGE); // best effort
+#endif
+      a.next = start;
+      a.limit = start + arenaChunk;
+    }
+    s = a.next;
+    a.next += slot;
+  }
+  for (vaddr g = s; g < s + guard; g += sizeof(mword)) *(mword*)g = StackCanaryWord;
+  return s;
+}
+
+void StackCache::arenaFree(size_t c, vaddr top) {
+  Arena& a = arena[c];
+  Link* l = (Link*)top - 1;
+  uintptr_t prev = __atomic_load_n(&a.top, __ATOMIC_RELAXED);
+  do {
+    l->next = (Link*)(prev & bitmask<uintptr_t>(TagShift));
+  } while (!__atomic_compare_exchange_n(&a.top, &prev, uintptr_t(l) | ((prev >> TagShift) + 1) << TagShift, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+// sample canary words in unprotected guard area (one per cache line)
+void StackCache::arenaCheck(vaddr bottom, size_t size, size_t guard) {
+  if (sizeClass(size, guard) >= Classes) return;
+  for (vaddr g = bottom; g < bottom + guard; g += 64) {
+    if slowpath(*(mword*)g != StackCanaryWord) RABORT("fibre stack overflow", FmtHex(bottom + guard));
+  }
+}
+
+vaddr StackCache::alloc(size_t size, size_t guard) {
+  size_t c = sizeClass(size, guard);
+  if (c < Classes) {
+    vaddr s = 0;
+    RuntimeDisablePreemption();
+    List* l = localList(c);
+    if (l && l->count) {
+      s = l->pop();
+    } else if (__atomic_load_n(&global[c].count, __ATOMIC_RELAXED)) {
+      ScopedLock<WorkerLock> sl(*_lfStackCacheLock);
+      if (global[c].count) s = global[c].pop();
+      // refill local list to half of its limit
+      if (l) while (global[c].count && l->count < localLimit / 2) l->push(global[c].pop());
+    }
+    BaseProcessor* proc = Context::CurrProcessorOrNull();
+    if (proc) {
+      if (s) proc->stats->stackHit.count();
+      else proc->stats->stackMiss.count();
+    }
+    RuntimeEnablePreemption();
+    if (s) return s - size - guard;
+    if (arenaChunk) return arenaAlloc(c, size, guard);
+  }
+  // add PROT_EXEC here to make stack executable (needed for nested C functions)
+  ptr_t ptr = mmap(0, size + guard, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+  RASSERT0(ptr != MAP_FAILED);
+  // set up protection page
+  if (guard) SYSCALL(mprotect(ptr, guard, PROT_NONE));
+  return vaddr(ptr);
+}
+
+void StackCache::release(vaddr bottom, size_t size, size_t guard) {
+  size_t c = sizeClass(size, guard);
+  if (c >= Classes) {
+    SYSCALL(munmap(ptr_t(bottom), size + guard));
+    return;
+  }
+  vaddr top = bottom + guard + size;
+  if (localLimit || globalLimit || arenaChunk) reclaim(top, size);
+  List spill, unmap;
+  RuntimeDisablePreemption();
+  List* l = localList(c);
+  if (l) {
+    l->push(top);
+    // high-water mark: move half of local stacks to global pool
+    if (l->count >= localLimit) while (l->count > localLimit / 2) spill.push(l->pop());
+  } else {
+    spill.push(top);
+  }
+  if (spill.count) {
+    ScopedLock<WorkerLock> sl(*_lfStackCacheLock);
+    while (spill.count) {
+      if (global[c].count < globalLimit) global[c].push(spill.pop());
+      else unmap.push(spill.pop());
+    }
+  }
+  RuntimeEnablePreemption();
+  if (arenaChunk) {
+    while (unmap.count) arenaFree(c, unmap.pop());
+    return;
+  }
+  while (unmap.count) SYSCALL(munmap(ptr_t(unmap.pop() - size - guard), size + guard));
+}
@@ -22,6 +22,8 @@
 #include "runtime/BaseProcessor.h"
 #include "runtime/BlockingSync.h"
 #include "runtime-glue/RuntimeContext.h"
+#include "libfibre/FibreLocal.h"
+#include "libfibre/StackCache.h"
 
 #include <vector>
 #include <string>
@@ -39,71 +41,22 @@ extern "C" void __splitstack_releasecontext(void *context[10]);
 #endif
 
 #if TESTING_ENABLE_DEBUGGING
-extern WorkerLock*              _lfFredDebugLock;
-extern FredList<FredDebugLink>* _lfFredDebugList;
+// fibre registry for gdb, sharded by creating worker thread
+struct FredDebugShard {
+  WorkerLock              lock;
+  FredList<FredDebugLink> list;
+} __caligned;
+static const size_t FredDebugShards = 64;
+extern FredDebugShard*          _lfFredDebugShards;
+extern size_t                   _lfFredDebugShardCount;
 extern size_t                   _lfFredDebugLink;
+extern size_t                   _lfFredDebugShard();
 #endif
 
 class Cluster;
 
-class FibreSpecific {
-public:
-  static const size_t FIBRE_KEYS_MAX = bitsize<mword>();
-  typedef void (*Destructor)(void*);
-private:
-  static FastMutex mutex;
-  static Bitmap<FIBRE_KEYS_MAX> bitmap;
-  static std::vector<Destructor> destructors;
-  std::vector<void*> values;
-protected:
-  FibreSpecific(size_t e = 0) : values(e) {}
-  void clearSpecific() {
-    size_t start = bitmap.find();
-    if (start >= FIBRE_KEYS_MAX) return;
-    size_t idx = start;
-    do {
-      if (destructors[idx] && idx < values.size() && values[idx]) destructors[idx](values[idx]);
-      idx = bitmap.findnext(idx);
-    } while (idx > start);
-  }
-public:
-  void setspecific(size_t idx, const void *value) {
-    RASSERT(idx < FIBRE_KEYS_MAX, idx);
-    RASSERT(bitmap.test(idx), idx);
-    if (idx >= values.size()) {
-      if (values.size() == 0) values.resize(1);
-      while (idx >= values.size()) values.resize(values.size() * 2);
-    }
-    values[idx] = (void*)value;
-  }
-  void* getspecific(size_t idx) {
-    RASSERT(idx < FIBRE_KEYS_MAX, idx);
-    RASSERT(bitmap.test(idx), idx);
-    return idx < values.size() ? values[idx] : nullptr;
-  }
-  static size_t key_create(Destructor d = nullptr) {
-    ScopedLock<FastMutex> sl(mutex);
-    size_t idx = bitmap.find(false);
-    RASSERT(idx < FIBRE_KEYS_MAX, idx);
-    bitmap.set(idx);
-    if (idx >= destructors.size()) {
-      if (destructors.size() == 0) destructors.resize(1);
-      while (idx >= destructors.size()) destructors.resize(destructors.size() * 2);
-    }
-    destructors[idx] = d;
-    return idx;
-  }
-  static void key_delete(size_t idx) {
-    ScopedLock<FastMutex> sl(mutex);
-    RASSERT(idx < FIBRE_KEYS_MAX, idx);
-    RASSERT(bitmap.test(idx), idx);
-    bitmap.clr(idx);
-    destructors[idx] = nullptr;
-  }
-};
-
 /** A Fibre object represents an independent execution context backed by a stack. */
-class Fibre : public Fred, public FibreSpecific {
+class Fibre : public Fred {
 public:
 #ifdef SPLIT_STACK
   static const size_t DefaultStackSize  = 4096;
@@ -120,55 +73,150 @@ private:
   void* splitStackContext[10]; // memory for split-stack context
 #else
   vaddr stackBottom;           // bottom of allocated memory for stack (including guard)
+  size_t stackGuard;           // guard size, see StackCache
+  bool stackColocated;         // fibre object at stack top, see create()
 #endif
   SyncPoint<WorkerLock> done;  // synchronization (join) at destructor
   ptr_t result;                // result transferred to join
-#if TESTING_ENABLE_DEBUGGING
+  bool autoDelete;             // see detachDelete()
+  Fibre* reapLink;             // terminated, waiting for deletion, see reap()
+  static Fibre* volatile reapList;
+  char* localBlock;            // fibre_local values, see FibreLocal.h
+  size_t localSize;            // bytes of 'localBlock': registrations at creation
+  size_t localUsed;            // bytes of 'localBlock' initialized
+  struct LocalOverflow {       // heap block for slots registered later
+    LocalOverflow* next;
+    size_t         base;       // first offset
+    size_t         end;        // beyond last offset
+    char*          mem;
+    char* slot(size_t offset) { return mem + base % FibreLocalBase::MaxAlign + offset - base; }
+  };
+  LocalOverflow* localOverflow;
+#if TESTING_ENABLE_DEBUGGING || TESTING_STACK_PROFILE
   std::string name;
 #endif
+#if TESTING_ENABLE_DEBUGGING
+  size_t debugShard;           // registry shard, see initDebug()
+#endif
+
+#if TESTING_STACK_PROFILE
+  static void stackPaint(vaddr bottom, size_t size);
+  void stackProfile();
+#endif
+
+  // fibre object placed below the (page-aligned) top of default stack
+  static const size_t ColocateMax = 1024;
+  static vaddr colocateTop(vaddr obj) { return align_up(obj + 1, vaddr(_lfPagesize)); }
+
+  static void reap();
+
+  size_t stackNone() {
+#ifndef SPLIT_STACK
+    stackColocated = false;
+#endif
+    return 0;
+  }
 
-  size_t stackAlloc(size_t size, size_t guard) {
+  size_t stackAlloc(size_t size, size_t guard, bool colocate = false) {
 #ifdef SPLIT_STACK
     (void)guard;
+    (void)colocate;
     vaddr stackBottom = (vaddr)__splitstack_makecontext(size, splitStackContext, &size);
     int off = 0; // do not block signals (blocking signals is slow!)
     __splitstack_block_signals_context(splitStackContext, &off, nullptr);
+    Fred::initStackPointer(stackBottom + size);
 #else
     // check that requested size/guard is a multiple of page size
     RASSERT(aligned(size, _lfPagesize), size);
     RASSERT(aligned(guard, _lfPagesize), size);
-    // reserve/map size + protection
+    stackColocated = colocate;
+    if (stackColocated) {
+      RASSERT0(size == DefaultStackSize && guard == DefaultStackGuard);
+      stackBottom = colocateTop(vaddr(this)) - size - guard;
+    } else {
+      // reserve/map size + protection (or reuse cached stack)
+      stackBottom = StackCache::alloc(size, guard);
+    }
+    stackGuard = guard;
     size += guard;
-    // add PROT_EXEC here to make stack executable (needed for nested C functions)
-    ptr_t ptr = mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
-    RASSERT0(ptr != MAP_FAILED);
-    // set up protection page
-    if (guard) SYSCALL(mprotect(ptr, guard, PROT_NONE));
-    stackBottom = vaddr(ptr);
+    // fibre_local block at top of stack, sized by current registrations
+    localSize = FibreLocalBase::reserved();
+    vaddr top = align_down((stackColocated ? vaddr(this) : stackBottom + size) - localSize, vaddr(FibreLocalBase::MaxAlign));
+    localBlock = (char*)top;
+#if TESTING_STACK_PROFILE
+    stackPaint(stackBottom + guard, top - stackBottom - guard);
+#endif
+    Fred::initStackPointer(top);
 #endif
-    Fred::initStackPointer(stackBottom + size);
     return size;
   }
 
+#ifndef SPLIT_STACK
+  vaddr stackTop() const { return stackColocated ? vaddr(this) : stackBottom + stackSize; }
+#endif
+
   void stackFree() {
 #ifdef SPLIT_STACK
     if (stackSize) __splitstack_releasecontext(splitStackContext);
 #else
-    if (stackSize) SYSCALL(munmap(ptr_t(stackBottom), stackSize));
+    if (stackSize && !stackColocated) StackCache::release(stackBottom, stackSize - stackGuard, stackGuard);
 #endif
   }
 
+  bool localHeap() const {
+#ifdef SPLIT_STACK
+    return true;
+#else
+    return stackSize == 0;
+#endif
+  }
+
+  // block on stack is set up by stackAlloc()
+  void initLocal() {
+    localUsed = 0;
+    localOverflow = nullptr;
+    if (localHeap()) {
+      localBlock = nullptr;
+      localSize = 0;
+    }
+  }
+
+  void clearLocal() {
+    if (!localUsed && !localOverflow) return;
+    FibreLocalBase::destroyAll(*this);
+    localUsed = 0;
+    while (localOverflow) {
+      LocalOverflow* o = localOverflow;
+      localOverflow = o->next;
+      free(o->mem);
+      delete o;
+    }
+  }
+
+  ptr_t localFind(size_t offset) const {
+    if (offset < localUsed) return localBlock + offset;
+    for (LocalOverflow* o = localOverflow; o; o = o->next) {
+      if (offset >= o->base && offset < o->end) return o->slot(offset);
+    }
+    return nullptr;
+  }
+
+  ptr_t localExtend(size_t offset);
+
   void initDebug() {
 #if TESTING_ENABLE_DEBUGGING
-    ScopedLock<WorkerLock> sl(*_lfFredDebugLock);
-    _lfFredDebugList->push_back(*this);
+    debugShard = _lfFredDebugShard();
+    FredDebugShard& shard = _lfFredDebugShards[debugShard];
+    ScopedLock<WorkerLock> sl(shard.lock);
+    shard.list.push_back(*this);
 #endif
   }
 
   void clearDebug() {
 #if TESTING_ENABLE_DEBUGGING
-    ScopedLock<WorkerLock> sl(*_lfFredDebugLock);
-    _lfFredDebugList->remove(*this);
+    FredDebugShard& shard = _lfFredDebugShards[debugShard];
+    ScopedLock<WorkerLock> sl(shard.lock);
+    shard.list.remove(*this);
 #endif
   }
 
@@ -181,48 +229,104 @@ private:
     return this;
   }
 
+  // co-located constructor, see create()
+  Fibre(Scheduler& sched, _friend<Fibre>)
+  : Fred(sched), stackSize(stackAlloc(DefaultStackSize, DefaultStackGuard, true)), autoDelete(false) { initLocal(); initDebug(); }
+
 public:
   struct ExitException {};
 
   /** Constructor. */
   Fibre(Scheduler& sched = Context::CurrProcessor().getScheduler(), size_t size = DefaultStackSize, size_t guard = DefaultStackGuard)
-  : Fred(sched), stackSize(stackAlloc(size, guard)) { initDebug(); }
+  : Fred(sched), stackSize(stackAlloc(size, guard)), autoDelete(false) { initLocal(); initDebug(); reap(); }
 
   // system constructor for idle/main loop (bootstrap) on existing pthread stack (size = 0)
   // system constructor with setting affinity to processor (size != 0)
   Fibre(BaseProcessor &p, _friend<Cluster>, size_t size = DefaultStackSize, size_t guard = DefaultStackGuard)
-  : Fred(p), stackSize(size ? stackAlloc(size, guard) : 0) { initDebug(); }
+  : Fred(p), stackSize(size ? stackAlloc(size, guard) : stackNone()), autoDelete(false) { initLocal(); initDebug(); }
+
+  /** Create fibre with 'new' semantics. With default stack size and guard,
+      the fibre object is placed at the top of a (cached) stack and needs no
+      separate heap allocation, unless stack guards are unprotected (see
+      StackCache).  Release with 'delete', as usual. */
+  static Fibre* create(Scheduler& sched = Context::CurrProcessor().getScheduler(), size_t size = DefaultStackSize, size_t guard = DefaultStackGuard) {
+#ifndef SPLIT_STACK
+    if (size == DefaultStackSize && guard == DefaultStackGuard && StackCache::guarded()) {
+      static_assert(sizeof(Fibre) <= ColocateMax, "Fibre object too large for co-location");
+      reap();
+      vaddr top = StackCache::alloc(DefaultStackSize, DefaultStackGuard) + DefaultStackGuard + DefaultStackSize;
+      vaddr obj = align_down(top - sizeof(Fibre), vaddr(64));
+      return new (ptr_t(obj)) Fibre(sched, _friend<Fibre>());
+    }
+#endif
+    return new Fibre(sched, size, guard);
+  }
+
+#ifndef SPLIT_STACK
+  // co-located object and stack are returned together, see create()
+  static void* operator new(size_t sz);
+  static void* operator new(size_t, void* p) { return p; }
+  static void operator delete(void* p);
+#endif
+
+  // worker about to park, see RuntimeIdleReap()
+  static void reap(_friend<BaseProcessor>) { reap(); }
 
   //  explicit final notification for idle loop or main loop (bootstrap) on pthread stack
   void endDirect(_friend<Cluster>) { done.post(); }
 
   /** Destructor with synchronization. */
-  ~Fibre() { join(); }
+  ~Fibre() {
+    join();
+    if (localHeap()) {
+      clearLocal();
+      free(localBlock);
+    }
+  }
   /** Explicit join. Called automatically by destructor. */
   ptr_t join() { done.wait(); return result; }
   /** Detach fibre (no waiting for join synchronization). */
   void detach() { done.detach(); }
+  /** Detach fibre and delete it after termination. Only for fibres created
+      with 'new' or create().  Deletion is deferred to a subsequent fibre
+      creation or an idle worker, since the final context switch cannot
+      release memory. */
+  void detachDelete() {
+    autoDelete = true; // read by destroy() after 'done' lock handoff
+    done.detach();
+  }
   /** Exit fibre (with join, if not detached). */
   static void exit(ptr_t p = nullptr) __noreturn;
 
   // callback after Fred's main routine has finished
   void finalize(ptr_t e) {
     result = e;
-    clearSpecific();
+    clearLocal();
+#ifndef SPLIT_STACK
+    if (stackSize) StackCache::check(stackBottom, stackSize - stackGuard, stackGuard);
+#if TESTING_STACK_PROFILE
+    if (stackSize) stackProfile();
+#endif
+#endif
   }
 
   // callback from Fred via Runtime after final context switch
   void destroy(_friend<Fred>) {
     clearDebug();
     stackFree();
-    done.post();
+    if (!done.post() && autoDelete) {
+      // detached: nobody else references this object - 'this' must not be used after push
+      Fibre* head = __atomic_load_n(&reapList, __ATOMIC_RELAXED);
+      do reapLink = head;
+      while (!__atomic_compare_exchange_n(&reapList, &head, this, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
   }
 
   void setup(ptr_t func, ptr_t p1, ptr_t p2, ptr_t p3, _friend<Cluster>) { // hide base class setup()
     Fred::setup(func, p1, p2, p3);
   }
 
-#if TESTING_ENABLE_DEBUGGING
+#if TESTING_ENABLE_DEBUGGING || TESTING_STACK_PROFILE
   Fibre* setName(const std::string& n) {
     name = n.size() >= 2 && n[1] == ':' ? n : "u:" + n;
     return this;
@@ -276,11 +380,67 @@ public:
   void activate(_friend<Fred>) {
     fp.restore();
   }
+
+  // fibre_local slot at 'offset': initialize block lazily
+  ptr_t localSlot(size_t offset, _friend<FibreLocalBase>) {
+    if fastpath(offset < localUsed) return localBlock + offset;
+    return localExtend(offset);
+  }
+
+  // existing slot at 'offset' or null, see FibreLocalBase::destroyAll()
+  ptr_t localFind(size_t offset, _friend<FibreLocalBase>) const { return localFind(offset); }
 };
 
+inline ptr_t FibreLocalBase::find(Fibre* f) const {
+  return f->localSlot(offset, _friend<FibreLocalBase>());
+}
+
 /** @brief Obtain pointer to current Fibre object. */
 inline Fibre* CurrFibre() {
   return (Fibre*)Context::CurrFred();
 }
 
+#if TESTING_STACKLESS_TASKS
+/** @brief Stackless task, runs to completion on a worker's idle stack.
+    'func' is called with 'canBlock' false and returns true when finished.
+    If it would need to block, it returns false (before any side effects
+    it cannot repeat) and the task is promoted to a detached fibre, where
+    'func' is called again with 'canBlock' true. */
+class FibreTask : public Task {
+public:
+  typedef bool (*Func)(ptr_t arg, bool canBlock);
+
+private:
+  Func  func;
+  ptr_t arg;
+  Scheduler& scheduler;
+
+  FibreTask(Func f, ptr_t a, Scheduler& s) : Task(invoke), func(f), arg(a), scheduler(s) {}
+  static void invoke(Task& t);
+  static void promoted(FibreTask* t);
+
+public:
+  /** Queue task for execution; no join, results must be passed via 'arg'. */
+  static void spawn(Func f, ptr_t a, Scheduler& s = Context::CurrProcessor().getScheduler());
+};
+#endif
+
+/** Access value in given fibre, which must be the current fibre or not running. */
+template<typename T>
+inline T& fibre_local<T>::get(Fibre* f) {
+  mword* init = (mword*)find(f);
+  T* value = (T*)((char*)init + valueOffset);
+  if slowpath(!*init) {
+    new (value) T();
+    *init = 1;
+  }
+  return *value;
+}
+
+/** Access value in current fibre. */
+template<typename T>
+inline T& fibre_local<T>::get() {
+  return get(CurrFibre());
+}
+
 #endif /* _Fibre_h_ */
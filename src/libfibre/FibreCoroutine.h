@@ -0,0 +1,397 @@
+/******************************************************************************
+    Copyright (C) Martin Karsten 2015-2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#ifndef _FibreCoroutine_h_
+#define _FibreCoroutine_h_ 1
+
+/** @file */
+
+#include "libfibre/EventScope.h"
+
+#if !TESTING_COROUTINES
+#error FibreCoroutine.h requires TESTING_COROUTINES
+#endif
+
+#if __cplusplus < 202002L
+#error FibreCoroutine.h requires C++20 (make CXXSTD=c++20)
+#endif
+
+#include <coroutine>
+#include <map>
+#include <tuple>
+
+/*
+A CoExecutor is a single fibre that resumes C++20 coroutines, so all of its
+coroutines share one stack.  A suspended coroutine is represented by a
+CoWaiter, which is handed to the event poller (EventScope::coWait), to a
+CoSemaphore, or to the executor's timer list.  Running the waiter's task from
+any context queues the waiter at its executor, which then calls 'resumeFunc'
+on the executor fibre.  Coroutines must not call fibre-blocking operations
+(lfRecv, FredMutex, ...), since those would stall all coroutines of the
+executor.  File descriptors used by coroutines must not use io_uring and must
+not be waited on by fibres at the same time.
+*/
+
+class CoExecutor;
+
+class CoWaiter : public Task {
+  friend class CoExecutor;
+public:
+  typedef void (*Resume)(CoWaiter&);
+  std::coroutine_handle<> handle;
+
+private:
+  CoExecutor* executor;
+  Resume      resumeFunc;                                 // on executor fibre
+  static inline void wake(Task& t);                       // any context
+  static void resumeHandle(CoWaiter& w) { w.handle.resume(); }
+
+public:
+  CoWaiter(Resume r = resumeHandle) : Task(wake), executor(nullptr), resumeFunc(r) {}
+  void prepare(std::coroutine_handle<> h, CoExecutor& e) { handle = h; executor = &e; }
+};
+
+struct CoPromiseBase {
+  CoExecutor*             executor = nullptr;
+  std::coroutine_handle<> continuation;                   // awaiting coroutine, none if spawned
+  CoWaiter                start;
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  void unhandled_exception() { RABORT0(); }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template<typename P>
+    inline std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept;
+    void await_resume() noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+};
+
+template<typename T>
+struct CoPromise : public CoPromiseBase {
+  T value;
+  void return_value(T v) { value = std::move(v); }
+  T result() { return std::move(value); }
+};
+
+template<>
+struct CoPromise<void> : public CoPromiseBase {
+  void return_void() {}
+  void result() {}
+};
+
+/** @brief Coroutine type for CoExecutor.
+    Started lazily: either by CoExecutor::spawn() or by 'co_await' in another
+    coroutine, which then continues when the awaited coroutine returns. */
+template<typename T = void>
+class CoTask {
+  friend class CoExecutor;
+public:
+  struct promise_type : public CoPromise<T> {
+    CoTask get_return_object() { return CoTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+  };
+
+private:
+  std::coroutine_handle<promise_type> handle;
+  explicit CoTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+public:
+  CoTask(CoTask&& t) : handle(t.handle) { t.handle = nullptr; }
+  CoTask(const CoTask&) = delete;
+  CoTask& operator=(const CoTask&) = delete;
+  ~CoTask() { if (handle) handle.destroy(); }
+
+  bool await_ready() const noexcept { return false; }
+  template<typename P>
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) noexcept {
+    handle.promise().executor = caller.promise().executor;
+    handle.promise().continuation = caller;
+    return handle;                                        // symmetric transfer
+  }
+  T await_resume() { return handle.promise().result(); }
+};
+
+/** @brief Fibre that runs coroutines on its stack.
+    Use one executor per worker for parallelism.  The destructor waits for
+    all spawned coroutines to finish. */
+class CoExecutor {
+  friend class CoWaiter;
+  friend struct CoPromiseBase;
+  static const size_t BatchMax = 64;                      // resumptions before yielding fibre
+
+  TaskQueue       ready;
+  volatile bool   sleeping;
+  volatile bool   finish;
+  volatile size_t live;                                   // spawned, not finished
+  Poller::SyncSem sem;
+  std::multimap<Time,CoWaiter*> timers;                   // executor fibre only
+  Fibre*          fibre;
+
+  void schedule(CoWaiter& w) {
+    ready.push(w);
+    if (__atomic_exchange_n(&sleeping, false, __ATOMIC_SEQ_CST)) sem.V();
+  }
+
+  bool expire() {
+    if (timers.empty()) return false;
+    Time now = Runtime::Timer::now();
+    bool fired = false;
+    for (auto iter = timers.begin(); iter != timers.end() && iter->first <= now; iter = timers.begin()) {
+      CoWaiter* w = iter->second;
+      timers.erase(iter);
+      w->resumeFunc(*w);
+      fired = true;
+    }
+    return fired;
+  }
+
+  void loop() {
+    size_t count = 0;
+    for (;;) {
+      Task* t = ready.pop();
+      if (t) {
+        CoWaiter* w = static_cast<CoWaiter*>(t);
+        w->resumeFunc(*w);
+        count += 1;
+        if (count % BatchMax == 0) {
+          expire();
+          Fibre::yield();
+        }
+        continue;
+      }
+      if (expire()) continue;
+      if (finish && live == 0) return;
+      // a producer that finds 'sleeping' set after push() posts 'sem'
+      __atomic_store_n(&sleeping, true, __ATOMIC_SEQ_CST);
+      t = ready.pop();
+      if (t) {
+        __atomic_store_n(&sleeping, false, __ATOMIC_RELAXED);
+        CoWaiter* w = static_cast<CoWaiter*>(t);
+        w->resumeFunc(*w);
+        continue;
+      }
+      if (timers.empty()) sem.P();
+      else sem.P(timers.begin()->first);
+      __atomic_store_n(&sleeping, false, __ATOMIC_RELAXED);
+    }
+  }
+
+  static void loopSetup(CoExecutor* This) { This->loop(); }
+
+public:
+  CoExecutor(Cluster& cluster = Context::CurrCluster()) : sleeping(false), finish(false), live(0) {
+    fibre = new Fibre(cluster);
+    fibre->setName("s:CoExec");
+    fibre->run(loopSetup, this);
+  }
+  ~CoExecutor() {
+    __atomic_store_n(&finish, true, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&sleeping, false, __ATOMIC_SEQ_CST)) sem.V();
+    delete fibre;                                         // join
+  }
+
+  /** Start detached coroutine; callable from fibres and coroutines. */
+  void spawn(CoTask<void>&& t) {
+    std::coroutine_handle<CoTask<void>::promise_type> h = t.handle;
+    t.handle = nullptr;
+    h.promise().executor = this;
+    h.promise().start.prepare(h, *this);
+    __atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+    schedule(h.promise().start);
+  }
+
+  /** Resume 'w' at 'timeout'; executor fibre only, see CoSleep. */
+  void addTimer(const Time& timeout, CoWaiter& w) {
+    timers.insert({timeout, &w});
+  }
+};
+
+inline void CoWaiter::wake(Task& t) {
+  CoWaiter& w = static_cast<CoWaiter&>(t);
+  w.executor->schedule(w);
+}
+
+template<typename P>
+inline std::coroutine_handle<> CoPromiseBase::FinalAwaiter::await_suspend(std::coroutine_handle<P> h) noexcept {
+  CoPromiseBase& p = h.promise();
+  if (p.continuation) return p.continuation;              // frame owned by awaiting CoTask
+  CoExecutor* e = p.executor;
+  h.destroy();
+  __atomic_sub_fetch(&e->live, 1, __ATOMIC_RELAXED);
+  return std::noop_coroutine();
+}
+
+/** @brief Awaitable: suspend coroutine until 'timeout' (absolute). */
+class CoSleep : public CoWaiter {
+  Time timeout;
+public:
+  CoSleep(const Time& t) : timeout(t) {}
+  bool await_ready() const { return timeout <= Runtime::Timer::now(); }
+  template<typename P>
+  void await_suspend(std::coroutine_handle<P> h) {
+    prepare(h, *h.promise().executor);
+    h.promise().executor->addTimer(timeout, *this);
+  }
+  void await_resume() {}
+};
+
+/** @brief Awaitable: let other coroutines of the executor run. */
+class CoYield : public CoWaiter {
+public:
+  bool await_ready() const { return false; }
+  template<typename P>
+  void await_suspend(std::coroutine_handle<P> h) {
+    prepare(h, *h.promise().executor);
+    run();                                                // queue at executor
+  }
+  void await_resume() {}
+};
+
+/** @brief Awaitable I/O: retry nonblocking call after each readiness event. */
+template<bool Input, typename T, class... Args>
+class CoIO : public CoWaiter {
+protected:
+  EventScope&         eventScope;
+  T                 (*iofunc)(int, Args...);
+  int                 fd;
+  std::tuple<Args...> args;
+  T                   ret;
+
+  bool tryIO() {
+    return std::apply([this](Args... a) { return eventScope.template coTryIO<Input>(ret, iofunc, fd, a...); }, args);
+  }
+
+  static void retry(CoWaiter& w) {
+    CoIO& This = static_cast<CoIO&>(w);
+    if (This.tryIO()) This.handle.resume();
+    else This.eventScope.template coWait<Input>(This.fd, This);
+  }
+
+public:
+  CoIO(T (*func)(int, Args...), int d, Args... a)
+  : CoWaiter(retry), eventScope(Context::CurrEventScope()), iofunc(func), fd(d), args(a...) {}
+
+  bool await_ready() {
+    if (eventScope.coBlocking(fd)) return tryIO();
+    ret = std::apply([this](Args... a) { return iofunc(fd, a...); }, args);
+    return true;
+  }
+  template<typename P>
+  void await_suspend(std::coroutine_handle<P> h) {
+    prepare(h, *h.promise().executor);
+    eventScope.template coWait<Input>(fd, *this);
+  }
+  T await_resume() { return ret; }
+};
+
+class CoAccept : public CoIO<true,int,sockaddr*,socklen_t*,int> {
+  int flags;
+public:
+  CoAccept(int d, sockaddr* addr, socklen_t* addrlen, int f)
+  : CoIO(::accept4, d, addr, addrlen, f | SOCK_NONBLOCK), flags(f) {}
+  int await_resume() {
+    if (ret >= 0) eventScope.coAccepted(fd, ret, flags);
+    return ret;
+  }
+};
+
+/** @brief Coroutine semaphore, V() is also callable from fibres. */
+class CoSemaphore {
+  WorkerLock           lock;
+  ssize_t              counter;
+  IntrusiveQueue<Task> waiters;
+
+public:
+  class Awaiter : public CoWaiter {
+    CoSemaphore& sem;
+  public:
+    Awaiter(CoSemaphore& s) : sem(s) {}
+    bool await_ready() const { return false; }
+    template<typename P>
+    bool await_suspend(std::coroutine_handle<P> h) {
+      prepare(h, *h.promise().executor);
+      ScopedLock<WorkerLock> sl(sem.lock);
+      if (sem.counter > 0) {
+        sem.counter -= 1;
+        return false;                                     // continue without suspending
+      }
+      sem.waiters.push(*this);
+      return true;
+    }
+    void await_resume() {}
+  };
+
+  explicit CoSemaphore(ssize_t c = 0) : counter(c) {}
+  ~CoSemaphore() { RASSERT0(waiters.empty()); }
+
+  Awaiter P() { return Awaiter(*this); }
+  bool tryP() {
+    ScopedLock<WorkerLock> sl(lock);
+    if (counter < 1) return false;
+    counter -= 1;
+    return true;
+  }
+  void V() {
+    lock.acquire();
+    Task* t = waiters.pop();
+    if (!t) counter += 1;
+    lock.release();
+    if (t) t->run();                                      // baton passing to waiter
+  }
+};
+
+/** @brief Coroutine mutex. */
+class CoMutex {
+  CoSemaphore sem;
+public:
+  CoMutex() : sem(1) {}
+  CoSemaphore::Awaiter acquire() { return sem.P(); }
+  bool tryAcquire() { return sem.tryP(); }
+  void release() { sem.V(); }
+};
+
+/** @brief Awaitable accept. */
+static inline CoAccept lfCoAccept(int fd, sockaddr *addr, socklen_t *addrlen, int flags = 0) {
+  return CoAccept(fd, addr, addrlen, flags);
+}
+
+/** @brief Awaitable read. */
+static inline CoIO<true,ssize_t,void*,size_t> lfCoRead(int fd, void *buf, size_t nbyte) {
+  return CoIO<true,ssize_t,void*,size_t>(::read, fd, buf, nbyte);
+}
+
+/** @brief Awaitable write. */
+static inline CoIO<false,ssize_t,const void*,size_t> lfCoWrite(int fd, const void *buf, size_t nbyte) {
+  return CoIO<false,ssize_t,const void*,size_t>(::write, fd, buf, nbyte);
+}
+
+/** @brief Awaitable recv. */
+static inline CoIO<true,ssize_t,void*,size_t,int> lfCoRecv(int socket, void *buffer, size_t length, int flags) {
+  return CoIO<true,ssize_t,void*,size_t,int>(::recv, socket, buffer, length, flags);
+}
+
+/** @brief Awaitable send. */
+static inline CoIO<false,ssize_t,const void*,size_t,int> lfCoSend(int socket, const void *buffer, size_t length, int flags) {
+  return CoIO<false,ssize_t,const void*,size_t,int>(::send, socket, buffer, length, flags);
+}
+
+/** @brief Awaitable sleep (relative). */
+static inline CoSleep lfCoSleep(const Time& timeout) {
+  return CoSleep(Runtime::Timer::now() + timeout);
+}
+
+#endif /* _FibreCoroutine_h_ */
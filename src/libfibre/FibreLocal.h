@@ -0,0 +1,111 @@
+/******************************************************************************
+    Copyright (C) Martin Karsten 2015-2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#ifndef _FibreLocal_h_
+#define _FibreLocal_h_ 1
+
+#include "runtime/Basics.h"
+
+#include <new>
+
+class Fibre;
+
+/*
+Each fibre_local object is assigned a fixed offset into a per-fibre block
+when it is constructed (typically during static initialization).  The block
+is reserved at the top of each fibre stack, sized by the registrations at
+fibre creation; fibres without own stack (main and idle fibres) allocate it
+on first use.  Slots registered after a fibre's block was sized are placed
+in additional heap blocks of that fibre.  A slot holds an 'initialized'
+word followed by the value, which is constructed on first access in each
+fibre and destroyed when the fibre terminates.
+*/
+class FibreLocalBase {
+public:
+  typedef void (*Destructor)(FibreLocalBase&, ptr_t);
+
+private:
+  FibreLocalBase* next;
+  size_t          offset;      // slot offset in block
+  Destructor      destructor;
+
+  static FibreLocalBase* volatile list;
+  static volatile size_t          reservedBytes;
+
+protected:
+  size_t          valueOffset; // value offset in slot
+
+  FibreLocalBase(size_t size, size_t align, Destructor d);
+  ptr_t find(Fibre* f) const; // see Fibre.h
+
+public:
+  static const size_t MaxAlign = 64;
+  static size_t reserved() { return __atomic_load_n(&reservedBytes, __ATOMIC_ACQUIRE); }
+  // destroy all constructed values of fibre, called at fibre exit
+  static void destroyAll(Fibre& f);
+};
+
+/** Typed fibre-local variable with static offset, to be used from fibres only. */
+template<typename T>
+class fibre_local : public FibreLocalBase {
+  static void destroy(FibreLocalBase&, ptr_t p) { ((T*)p)->~T(); }
+public:
+  fibre_local() : FibreLocalBase(sizeof(T), alignof(T), destroy) {}
+  fibre_local(const fibre_local&) = delete;
+  fibre_local& operator=(const fibre_local&) = delete;
+  T& get(Fibre* f);
+  T& get();
+  T& operator*()  { return get(); }
+  T* operator->() { return &get(); }
+};
+
+/** Slot for pthread-style keys, see fibre_key_create().  Deleted keys are
+    reused; values carry the key's generation, so that values stored under
+    a deleted key read as null. Key objects are never freed. */
+class FibreKey : public FibreLocalBase {
+public:
+  typedef void (*KeyDestructor)(void*);
+
+private:
+  struct Value { size_t gen; void* value; }; // zeroed slot: no value
+  volatile size_t gen;
+  KeyDestructor   keyDestructor;
+  FibreKey*       nextFree;
+
+  static volatile uintptr_t freeList;        // tagged pointer against ABA
+  static const size_t TagShift = 48;
+
+  FibreKey(KeyDestructor d) : FibreLocalBase(sizeof(Value), alignof(Value), destroy), gen(1), keyDestructor(d) {}
+  static void destroy(FibreLocalBase& b, ptr_t p);
+  Value& slot(Fibre* f) const { return *(Value*)((char*)find(f) + valueOffset); }
+
+public:
+  static FibreKey* create(KeyDestructor d);
+  void remove();
+  void* get(Fibre* f) const {
+    Value& v = slot(f);
+    return v.gen == gen ? v.value : nullptr;
+  }
+  void set(Fibre* f, const void* value) {
+    mword* init = (mword*)find(f);
+    Value& v = *(Value*)((char*)init + valueOffset);
+    v.gen = gen;
+    v.value = (void*)value;
+    *init = 1;                               // destructor runs at fibre exit
+  }
+};
+
+#endif /* _FibreLocal_h_ */
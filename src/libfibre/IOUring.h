@@ -21,8 +21,18 @@
 #include "libfibre/Fibre.h"
 
 #include <cstring>
+#include <list>
 #include <liburing.h>
 #include <sys/eventfd.h>
+#if TESTING_IO_URING_MULTISHOT || TESTING_IO_URING_ADAPTIVE
+#include <algorithm>
+#endif
+#if TESTING_IO_URING_MULTISHOT
+#include <deque>
+#endif
+#if TESTING_IO_URING_MULTISHOT || TESTING_IO_URING_FIXED
+#include <sys/mman.h>
+#endif
 
 #if defined(OLDURING)
 typedef off_t UringOffsetType; // liburing version 2.0 and lower
@@ -30,17 +40,303 @@ typedef off_t UringOffsetType; // liburing version 2.0 and lower
 typedef __u64 UringOffsetType; // liburing version 2.1 and higher
 #endif
 
+#if TESTING_IO_URING_MULTISHOT
+class IOUring;
+
+/*
+ Per-fd state of a multishot accept or recv request.  One armed request
+ keeps delivering completions, which are handed to a waiting fibre or
+ queued for the next accept/recv call on the same fd.  The request is
+ re-armed only when the kernel has terminated it and nothing is queued.
+ Received data arrives in buffers provided by the arming ring.  A
+ connection holds at most MaxHeld of these buffers in its queue: beyond
+ that, the request is cancelled and re-armed once the reader has caught
+ up.  Any other input on the fd (readv, recvmsg, recv with flags, ...)
+ disarms multishot delivery for good and consumes queued data first, so
+ that single-shot requests never overtake received data.  The state is
+ referenced by the fd table and by the ring while armed.  Rings are only
+ used by their owner worker, so closing or disarming cancels the armed
+ request from the arming worker.
+*/
+class UringMultishot {
+  struct Result {
+    int      res;    // byte count, new fd, or -errno
+    int      bid;    // provided buffer, -1 if none
+    int      offset; // bytes already consumed from buffer
+    IOUring* ring;   // owner of provided buffer
+  };
+
+  static const size_t MaxHeld = 64;     // queued provided buffers per connection
+
+  WorkerLock                  lock;
+  std::deque<Result>          results;  // -ECANCELED: end of cancelled request
+  LockedSemaphore<WorkerLock> avail;
+  LockedSemaphore<WorkerLock> ended;    // armed request terminated, see disarm()
+  size_t                      refs;     // fd table + armed request
+  size_t                      held;     // provided buffers in 'results'
+  size_t                      waiters;  // fibres waiting in disarm()
+  BaseProcessor*              armProc;  // worker of arming ring
+  IOUring*                    armRing;
+  bool                        armed;
+  bool                        pausing;  // cancelled: too many buffers held
+  bool                        closed;
+  bool                        fallback; // disarmed or not supported -> single-shot
+  const bool                  acceptor;
+
+  void release() {
+    if (__atomic_sub_fetch(&refs, 1, __ATOMIC_ACQ_REL) == 0) delete this;
+  }
+
+  inline void giveBack(const Result& r);
+  inline void discard(const Result& r);
+  inline void requeue(const Result& r);
+  inline Result next(IOUring& ring, int fd);
+  inline bool take(const struct iovec* iov, int cnt, bool peek, ssize_t& ret);
+  inline void cancel();
+  inline void disarm();
+
+public:
+  UringMultishot(bool a) : refs(1), held(0), waiters(0), armProc(nullptr), armRing(nullptr),
+    armed(false), pausing(false), closed(false), fallback(false), acceptor(a) {}
+
+  inline void complete(IOUring& ring, int res, unsigned flags);
+  inline int accept(IOUring& ring, int fd, sockaddr* addr, socklen_t* addrlen, int flags);
+  inline ssize_t recv(IOUring& ring, int fd, void* buf, size_t len);
+  inline bool input(const struct iovec* iov, int cnt, bool peek, ssize_t& ret);
+  inline void close();
+};
+#endif
+
+#if TESTING_IO_URING_FIXED
+/*
+ Buffer pool of an event scope.  The whole pool is registered as fixed
+ buffer 0 with every worker ring of the scope, so a fixed read or write
+ can be submitted on whichever worker the fibre runs.  See lfReadFixed().
+*/
+class UringBufferPool {
+  WorkerLock lock;
+  char*      mem;
+  ptr_t      freeList; // linked through first word of free buffers
+public:
+  static const size_t Count = 256;
+  static const size_t Size = 16384;
+
+  UringBufferPool() : freeList(nullptr) {
+    ptr_t ptr = mmap(0, Count * Size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+    RASSERT0(ptr != MAP_FAILED);
+    mem = (char*)ptr;
+    for (size_t i = Count; i > 0; i -= 1) release(mem + (i - 1) * Size);
+  }
+  ~UringBufferPool() { SYSCALL(munmap(mem, Count * Size)); }
+
+  ptr_t acquire() {
+    ScopedLock<WorkerLock> sl(lock);
+    ptr_t buf = freeList;
+    if (buf) freeList = *(ptr_t*)buf;
+    return buf;
+  }
+
+  void release(ptr_t buf) {
+    RASSERT0(contains(buf, Size));
+    ScopedLock<WorkerLock> sl(lock);
+    *(ptr_t*)buf = freeList;
+    freeList = buf;
+  }
+
+  bool contains(cptr_t buf, size_t len) const {
+    return (const char*)buf >= mem && (const char*)buf + len <= mem + Count * Size;
+  }
+
+  struct iovec iov() const { return { mem, Count * Size }; }
+};
+#endif
+
+/*
+A worker ring can be set up with a kernel submission thread (SQPOLL), so
+that submissions do not need a system call while that thread is awake.
+The mode is selected at bootstrap: FibreUringSqpoll sets the SQ thread's
+idle timeout in milliseconds and enables the mode, FibreUringSqpollCpu
+pins the SQ threads round-robin to a cpu list (same format as
+FibreCpuSet), and FibreUringSqpollShared attaches all worker rings to the
+SQ thread of the first ring (IORING_SETUP_ATTACH_WQ).  If the kernel
+refuses SQPOLL (e.g., missing privileges before Linux 5.11), a ring falls
+back to regular submission.
+
+With TESTING_IO_URING_ADAPTIVE, pending SQEs are submitted when the batch
+is full, when the oldest one has waited for SubmitDeadlineNS (checked at
+each submission and each scheduling decision), or when the worker runs
+out of ready fibres and polls.  The batch size follows the arrival rate:
+it is the number of SQEs expected within the deadline, derived from a
+moving average of SQE inter-arrival gaps.
+*/
 class IOUring {
+#if TESTING_IO_URING_MULTISHOT
+  friend class UringMultishot;
+#endif
   int haltFD;
   uint64_t count;
   struct io_uring ring;
   size_t sqe_count;
+  size_t batchLimit;
   static const int BatchSize = 64;
   static const int NumEntries = 4096;
+
+#if TESTING_IO_URING_ADAPTIVE
+  static const size_t BatchMax = 256;
+  static const long long SubmitDeadlineNS = 20000;
+  Time      firstPending;  // arrival of oldest unsubmitted SQE
+  Time      lastArrival;
+  long long arrivalNS;     // moving average of SQE inter-arrival gap
+
+  void arrival() {
+    Time now = Runtime::Timer::now();
+    long long gap = std::min((now - lastArrival).toNS(), SubmitDeadlineNS);
+    arrivalNS += (gap - arrivalNS) / 8;
+    lastArrival = now;
+    if (sqe_count == 0) firstPending = now;
+  }
+
+  void adapt() {
+    if (ring.flags & IORING_SETUP_SQPOLL) return;
+    size_t expected = SubmitDeadlineNS / (arrivalNS + 1);
+    batchLimit = std::max(size_t(1), std::min(expected, BatchMax));
+  }
+#endif
+
+  struct SQPoll {         // zero-initialized before bootstrap, see setupSQPoll()
+    unsigned idleMS;      // 0: disabled
+    size_t*  cpus;        // SQ thread pinning, round-robin
+    size_t   cpuCount;
+    size_t   next;
+    bool     shared;
+    int      shareFD;     // ring owning the shared SQ thread
+  };
+  static SQPoll sqpoll;
+
+  int initSQPoll(struct io_uring_params& p) {
+    p.flags = IORING_SETUP_SQPOLL;
+    p.sq_thread_idle = sqpoll.idleMS;
+    // bootstrap creates the main worker's ring first: no race for shareFD
+    int shareFD = __atomic_load_n(&sqpoll.shareFD, __ATOMIC_ACQUIRE);
+    if (sqpoll.shared && shareFD >= 0) {
+      p.flags |= IORING_SETUP_ATTACH_WQ;
+      p.wq_fd = shareFD;
+    } else if (sqpoll.cpuCount) {
+      p.flags |= IORING_SETUP_SQ_AFF;
+      p.sq_thread_cpu = sqpoll.cpus[__atomic_fetch_add(&sqpoll.next, 1, __ATOMIC_RELAXED) % sqpoll.cpuCount];
+    }
+    int ret = io_uring_queue_init_params(NumEntries, &ring, &p);
+    if (ret < 0) {
+      DBG::outl(DBG::Level::Warning, "SQPOLL setup failed: ", -ret);
+      return ret;
+    }
+    if (sqpoll.shared && shareFD < 0) {
+      __atomic_compare_exchange_n(&sqpoll.shareFD, &shareFD, ring.ring_fd, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    }
+    return ret;
+  }
   struct io_uring_cqe* cqe[NumEntries];
 
   FredStats::IOUringStats* stats;
 
+#if TESTING_IO_URING_FIXED
+  // fd 'f' is registered in slot 'f' of a sparse file table
+  static const int FixedFiles = 4096;
+  bool     fileTable;             // file table registered
+  bool     bufferPool;            // scope's buffer pool registered
+  uint8_t  fileSlot[FixedFiles];  // set by owner worker, cleared by closing fibre, under EventScope's uringLock
+  IOUring* nextRing;              // EventScope's list of worker rings
+
+  void setupFiles() {
+    int* fds = new int[FixedFiles];
+    for (int i = 0; i < FixedFiles; i += 1) fds[i] = -1;
+    fileTable = io_uring_register_files(&ring, fds, FixedFiles) == 0;
+    delete [] fds;
+    memset(fileSlot, 0, sizeof(fileSlot));
+  }
+
+  void fixFile(struct io_uring_sqe* sqe) {
+    if (sqe->fd >= 0 && sqe->fd < FixedFiles && __atomic_load_n(&fileSlot[sqe->fd], __ATOMIC_RELAXED)) {
+      sqe->flags |= IOSQE_FIXED_FILE;
+    }
+  }
+#endif
+
+#if TESTING_IO_URING_MULTISHOT
+  // buffers for multishot recv: shared by all requests armed on this ring
+  static const unsigned short BufGroup = 0;
+  static const int BufCount = 1024; // power of 2
+  static const int BufSize = 4096;
+  static const size_t BufRingBytes = BufCount * sizeof(struct io_uring_buf);
+  static const uintptr_t MultishotTag = 1;
+  struct io_uring_buf_ring* bufRing; // nullptr: not supported by kernel
+  char* bufMem;
+  WorkerLock bufLock;                // buffers are returned by readers on any worker
+
+  void setupBufRing() {
+    ptr_t ptr = mmap(0, BufRingBytes + BufCount * BufSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+    RASSERT0(ptr != MAP_FAILED);
+    bufRing = (struct io_uring_buf_ring*)ptr;
+    bufMem = (char*)ptr + BufRingBytes;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)bufRing;
+    reg.ring_entries = BufCount;
+    reg.bgid = BufGroup;
+    if (io_uring_register_buf_ring(&ring, &reg, 0) < 0) { // kernel before 5.19
+      SYSCALL(munmap(ptr, BufRingBytes + BufCount * BufSize));
+      bufRing = nullptr;
+      return;
+    }
+    for (int i = 0; i < BufCount; i += 1) {
+      io_uring_buf_ring_add(bufRing, bufAddr(i), BufSize, i, io_uring_buf_ring_mask(BufCount), i);
+    }
+    io_uring_buf_ring_advance(bufRing, BufCount);
+  }
+
+  char* bufAddr(int bid) { return bufMem + size_t(bid) * BufSize; }
+
+  void returnBuf(int bid) {
+    ScopedLock<WorkerLock> sl(bufLock);
+    io_uring_buf_ring_add(bufRing, bufAddr(bid), BufSize, bid, io_uring_buf_ring_mask(BufCount), 0);
+    io_uring_buf_ring_advance(bufRing, 1);
+  }
+
+  // owner worker, during completion: cancel request holding too many buffers
+  bool pauseMultishot(UringMultishot& ms) {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    if (!sqe) return false;          // retried at next completion
+#if TESTING_IO_URING_ADAPTIVE
+    arrival();
+#endif
+    sqe_count += 1;
+    io_uring_prep_cancel(sqe, (ptr_t)(uintptr_t(&ms) | MultishotTag), 0);
+    io_uring_sqe_set_data(sqe, (ptr_t)MultishotTag);
+    return true;
+  }
+
+  bool arm(UringMultishot& ms, int fd, bool acceptor) {
+    if (!acceptor && !bufRing) return false;
+    RuntimeDisablePreemption();
+    struct io_uring_sqe* sqe = getSQE();
+    if (acceptor) {
+      io_uring_prep_multishot_accept(sqe, fd, nullptr, nullptr, 0);
+    } else {
+      io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+      sqe->flags |= IOSQE_BUFFER_SELECT;
+      sqe->buf_group = BufGroup;
+    }
+#if TESTING_IO_URING_FIXED
+    fixFile(sqe);
+#endif
+    io_uring_sqe_set_data(sqe, (ptr_t)(uintptr_t(&ms) | MultishotTag));
+    stats->multishot.count();
+    flushBatch();
+    RuntimeEnablePreemption();
+    return true;
+  }
+#endif
+
   struct Block {
     Fibre* fibre;
     int retcode;
@@ -49,9 +345,17 @@ class IOUring {
 
   void processCQE(struct io_uring_cqe* cqe, size_t& evcnt, size_t& resume) {
     Block* b = (Block*)io_uring_cqe_get_data(cqe);
+#if TESTING_IO_URING_MULTISHOT
+    if (uintptr_t(b) == MultishotTag) {
+      // completion of pauseMultishot(): nothing to do
+    } else if (uintptr_t(b) & MultishotTag) {
+      ((UringMultishot*)(uintptr_t(b) - MultishotTag))->complete(*this, cqe->res, cqe->flags);
+      evcnt += 1;
+    } else
+#endif
     if (b) {
       b->retcode = cqe->res;
-      b->fibre->resume();
+      b->fibre->resume<false,true>(); // run next: I/O completion
       evcnt += 1;
     } else {
       RASSERT(resume == 0, resume);
@@ -63,7 +367,12 @@ class IOUring {
 
   template<PollType PT>
   size_t internalPoll() {
-    if (PT != Check && sqe_count > 0) submitRing();
+    if (PT != Check && sqe_count > 0) {
+#if TESTING_IO_URING_ADAPTIVE
+      stats->flushIdle.count();
+#endif
+      submitRing();
+    }
     size_t resume = 0;
     size_t evcnt = 0;
     if (PT == Suspend) {
@@ -84,23 +393,53 @@ class IOUring {
     int submitted = TRY_SYSCALL_GE2(io_uring_submit(&ring), 1, EBUSY, EAGAIN);
     if (submitted < 0) return false;
     stats->submits.count(submitted);
+#if TESTING_IO_URING_ADAPTIVE
+    Time now = Runtime::Timer::now();
+    stats->delay.count((now - firstPending).toNS());
+    firstPending = now;                   // remainder, if any
+    adapt();
+#endif
     sqe_count -= submitted;
     return true;
   }
 
-  template<class... Args>
-  void submit(Block* b, void (*prepfunc)(struct io_uring_sqe *sqe, Args...), Args... a) {
-    struct io_uring_sqe* sqe;
+  struct io_uring_sqe* getSQE() {
     for (;;) {
-      sqe = io_uring_get_sqe(&ring);
-      if (sqe) break;
+      struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+      if (sqe) {
+#if TESTING_IO_URING_ADAPTIVE
+        arrival();
+#endif
+        sqe_count += 1;
+        return sqe;
+      }
       if (!submitRing()) internalPoll<Check>();
     }
-    sqe_count += 1;
+  }
+
+  void flushBatch() {
+#if TESTING_IO_URING_ADAPTIVE
+    if (sqe_count < batchLimit) {
+      if ((lastArrival - firstPending).toNS() < SubmitDeadlineNS) return;
+      stats->flushDeadline.count();
+    } else {
+      stats->flushFull.count();
+    }
+#else
+    if (sqe_count < batchLimit) return;
+#endif
+    while (!submitRing()) internalPoll<Check>();
+  }
+
+  template<class... Args>
+  void submit(Block* b, void (*prepfunc)(struct io_uring_sqe *sqe, Args...), Args... a) {
+    struct io_uring_sqe* sqe = getSQE();
     prepfunc(sqe, a...);
+#if TESTING_IO_URING_FIXED
+    if (b) fixFile(sqe);
+#endif
     io_uring_sqe_set_data(sqe, b);
-    if (sqe_count < BatchSize) return;
-    while (!submitRing()) internalPoll<Check>();
+    flushBatch();
   }
 
 public:
@@ -109,16 +448,55 @@ public:
     haltFD = SYSCALLIO(eventfd(0, EFD_CLOEXEC));
     struct io_uring_params p;
     memset(&p, 0, sizeof(p));
-    SYSCALLIO(io_uring_queue_init_params(NumEntries, &ring, &p));
-    DBG::outl(DBG::Level::Polling, "SQE: ", p.sq_entries, " CQE: ", p.cq_entries);
+    if (sqpoll.idleMS == 0 || initSQPoll(p) < 0) {
+      memset(&p, 0, sizeof(p));
+      SYSCALLIO(io_uring_queue_init_params(NumEntries, &ring, &p));
+    }
+    // SQ thread picks up submissions without syscall: no point in holding back
+    batchLimit = (p.flags & IORING_SETUP_SQPOLL) ? 1 : BatchSize;
+#if TESTING_IO_URING_ADAPTIVE
+    lastArrival = Runtime::Timer::now();
+    arrivalNS = SubmitDeadlineNS / BatchSize;
+#endif
+    DBG::outl(DBG::Level::Polling, "SQE: ", p.sq_entries, " CQE: ", p.cq_entries, " SQPOLL: ", bool(p.flags & IORING_SETUP_SQPOLL));
+#if TESTING_IO_URING_FIXED
+    setupFiles();
+    bufferPool = false;
+    nextRing = nullptr;
+#endif
+#if TESTING_IO_URING_MULTISHOT
+    setupBufRing();
+#endif
     submit(nullptr, io_uring_prep_read, haltFD, (void*)&count, (unsigned)sizeof(count), (UringOffsetType)0);
   }
 
   ~IOUring() {
+    int shareFD = ring.ring_fd;
+    if (sqpoll.shared) __atomic_compare_exchange_n(&sqpoll.shareFD, &shareFD, -1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
     io_uring_queue_exit(&ring);
+#if TESTING_IO_URING_MULTISHOT
+    if (bufRing) SYSCALL(munmap(bufRing, BufRingBytes + BufCount * BufSize));
+#endif
     SYSCALL(close(haltFD));
   }
 
+  static void setupSQPoll(unsigned idleMS, const std::list<size_t>& cpus, bool shared) {
+    sqpoll.cpus = new size_t[cpus.size()];
+    for (size_t cpu : cpus) sqpoll.cpus[sqpoll.cpuCount++] = cpu;
+    sqpoll.shared = shared;
+    sqpoll.shareFD = -1;
+    sqpoll.idleMS = idleMS;
+  }
+
+#if TESTING_IO_URING_ADAPTIVE
+  // called at each scheduling decision: submit if oldest SQE is overdue
+  void flush(_friend<Cluster>) {
+    if (sqe_count == 0 || (Runtime::Timer::now() - firstPending).toNS() < SubmitDeadlineNS) return;
+    stats->flushDeadline.count();
+    submitRing();
+  }
+#endif
+
   size_t poll(_friend<Cluster>) {
     return internalPoll<Poll>();
   }
@@ -143,6 +521,42 @@ public:
     SYSCALL_EQ(write(haltFD, &val, sizeof(val)), sizeof(val));
   }
 
+#if TESTING_IO_URING_FIXED
+  // owner worker only: 'fd' could be registered, but is not (yet)
+  bool canRegister(int fd) const {
+    return fileTable && fd < FixedFiles && !__atomic_load_n(&fileSlot[fd], __ATOMIC_RELAXED);
+  }
+
+  // owner worker only: subsequent operations on 'fd' use the registered file
+  // (un)registration is serialized by the EventScope, see EventScope::fixFD()
+  bool registerFile(int fd, _friend<EventScope>) {
+    if (!fileTable || fd >= FixedFiles) return false;
+    if (fileSlot[fd]) return true;
+    if (io_uring_register_files_update(&ring, fd, &fd, 1) != 1) return false;
+    __atomic_store_n(&fileSlot[fd], 1, __ATOMIC_RELAXED);
+    return true;
+  }
+
+  // any worker: 'fd' is about to be closed
+  void unregisterFile(int fd, _friend<EventScope>) {
+    if (fd >= FixedFiles || !__atomic_load_n(&fileSlot[fd], __ATOMIC_RELAXED)) return;
+    int none = -1;
+    SYSCALL_EQ(io_uring_register_files_update(&ring, fd, &none, 1), 1);
+    __atomic_store_n(&fileSlot[fd], 0, __ATOMIC_RELAXED);
+  }
+
+  void registerBuffers(const UringBufferPool& pool, _friend<EventScope>) {
+    struct iovec iov = pool.iov();
+    int ret = io_uring_register_buffers(&ring, &iov, 1);
+    bufferPool = (ret == 0);
+    if (ret < 0) DBG::outl(DBG::Level::Warning, "fixed buffer registration failed: ", -ret, " (RLIMIT_MEMLOCK?) - lfReadFixed/lfWriteFixed use regular I/O");
+  }
+
+  bool hasBufferPool() const { return bufferPool; }
+
+  IOUring*& next(_friend<EventScope>) { return nextRing; }
+#endif
+
   template<class... Args>
   int syncIO( void (*prepfunc)(struct io_uring_sqe *sqe, Args...), Args... a) {
     Block b(CurrFibre());
@@ -155,4 +569,242 @@ public:
   }
 };
 
+#if TESTING_IO_URING_MULTISHOT
+inline void UringMultishot::giveBack(const Result& r) {
+  r.ring->returnBuf(r.bid);
+  __atomic_sub_fetch(&held, 1, __ATOMIC_RELAXED);
+}
+
+inline void UringMultishot::discard(const Result& r) {
+  if (acceptor) {
+    if (r.res >= 0) SYSCALL(::close(r.res));
+  } else if (r.bid >= 0) {
+    r.ring->returnBuf(r.bid);
+  }
+}
+
+inline void UringMultishot::requeue(const Result& r) {
+  lock.acquire();
+  results.push_front(r);
+  lock.release();
+  avail.V();
+}
+
+inline UringMultishot::Result UringMultishot::next(IOUring& ring, int fd) {
+  for (;;) {
+    lock.acquire();
+    if (fallback && results.empty() && !armed) {
+      lock.release();
+      return { -EINVAL, -1, 0, nullptr };       // disarmed -> single-shot
+    }
+    bool arm = results.empty() && !armed && !closed && !fallback;
+    if (arm) {
+      armed = true;
+      armProc = &Context::CurrProcessor();
+      armRing = &ring;
+      __atomic_add_fetch(&refs, 1, __ATOMIC_ACQ_REL);
+    }
+    lock.release();
+    if (arm && !ring.arm(*this, fd, acceptor)) {
+      lock.acquire();
+      armed = false;
+      lock.release();
+      release();
+      return { -EINVAL, -1, 0, nullptr };       // no buffer ring -> single-shot
+    }
+    avail.P();
+    lock.acquire();
+    Result r = results.front();
+    results.pop_front();
+    lock.release();
+    if (r.res == -ECANCELED) continue;          // paused or disarmed: re-arm or fall back
+    if (r.res > 0 && r.offset == r.res) {       // consumed by take()
+      giveBack(r);
+      continue;
+    }
+    return r;
+  }
+}
+
+// copy queued data to 'iov', consumed unless 'peek'; false: nothing queued
+inline bool UringMultishot::take(const struct iovec* iov, int cnt, bool peek, ssize_t& ret) {
+  ScopedLock<WorkerLock> sl(lock);
+  bool found = false;
+  ret = 0;
+  int v = 0;
+  size_t voff = 0;
+  for (size_t i = 0; i < results.size() && v < cnt; ) {
+    Result& r = results[i];
+    int off = r.offset;
+    if (r.res > 0) {
+      while (off < r.res && v < cnt) {
+        size_t n = std::min(iov[v].iov_len - voff, size_t(r.res - off));
+        memcpy((char*)iov[v].iov_base + voff, r.ring->bufAddr(r.bid) + off, n);
+        off += n;
+        voff += n;
+        ret += n;
+        if (voff == iov[v].iov_len) {
+          v += 1;
+          voff = 0;
+        }
+      }
+      found = found || off > r.offset;
+    } else if (r.res != -ECANCELED) {           // EOF or error: only before data
+      if (found) break;
+      ret = r.res;
+      found = true;
+      v = cnt;
+    }
+    if (peek) {
+      i += 1;
+      continue;
+    }
+    // partial, or entry claimed by concurrent next(): leave in queue
+    if ((r.res > 0 && off < r.res) || avail.tryP() != SemaphoreWasOpen) {
+      r.offset = off;
+      break;
+    }
+    if (r.res > 0) giveBack(r);
+    results.pop_front();
+  }
+  if (ret < 0) _SysErrnoSet() = -ret;
+  return found;
+}
+
+// rings are used by their owner worker only: cancel from the arming worker
+inline void UringMultishot::cancel() {
+  Fibre* f = CurrFibre();
+  bool affinity = f->getAffinity();
+  BaseProcessor* prev = nullptr;
+  if (&Context::CurrProcessor() != armProc) {
+    f->setAffinity(true);                       // stay there until submitted
+    prev = &Fibre::migrate(*armProc);
+  }
+  int err = _SysErrno();
+  armRing->syncIO(io_uring_prep_cancel, (ptr_t)(uintptr_t(this) | IOUring::MultishotTag), 0);
+  _SysErrnoSet() = err;                         // ENOENT/EALREADY: completes anyway
+  if (prev) {
+    Fibre::migrate(*prev);
+    f->setAffinity(affinity);
+  }
+}
+
+// stop delivery for good and wait until the armed request has terminated,
+// so that all data it received is queued
+inline void UringMultishot::disarm() {
+  lock.acquire();
+  fallback = true;
+  if (!armed) {
+    lock.release();
+    return;
+  }
+  bool first = (waiters == 0);
+  waiters += 1;
+  lock.release();
+  if (first) cancel();
+  ended.P();
+}
+
+inline void UringMultishot::complete(IOUring& ring, int res, unsigned flags) {
+  Result r = { res, (flags & IORING_CQE_F_BUFFER) ? int(flags >> IORING_CQE_BUFFER_SHIFT) : -1, 0, &ring };
+  bool more = flags & IORING_CQE_F_MORE;
+  bool pause = false;
+  size_t wake = 0;
+  lock.acquire();
+  if (!more) {
+    armed = false;
+    pausing = false;
+    wake = waiters;
+    waiters = 0;
+  }
+  if (closed) {
+    lock.release();
+    discard(r);
+  } else {
+    if (r.bid >= 0 && __atomic_add_fetch(&held, 1, __ATOMIC_RELAXED) >= MaxHeld && more && !pausing) {
+      pause = pausing = true;
+    }
+    results.push_back(r);
+    lock.release();
+    Fred* next = avail.V<false>();
+    if (next) next->resume<false,true>(); // run next: I/O completion
+  }
+  if (pause && !ring.pauseMultishot(*this)) {
+    lock.acquire();
+    pausing = false;
+    lock.release();
+  }
+  for (; wake > 0; wake -= 1) {
+    Fred* next = ended.V<false>();
+    if (next) next->resume<false,true>();
+  }
+  if (!more) release();
+}
+
+inline int UringMultishot::accept(IOUring& ring, int fd, sockaddr* addr, socklen_t* addrlen, int flags) {
+  if (!fallback) {
+    Result r = next(ring, fd);
+    if (r.res >= 0) {
+      if (addr) ::getpeername(r.res, addr, addrlen); // request is armed without address
+      if (flags & SOCK_NONBLOCK) SYSCALL(::fcntl(r.res, F_SETFL, O_NONBLOCK));
+      if (flags & SOCK_CLOEXEC) SYSCALL(::fcntl(r.res, F_SETFD, FD_CLOEXEC));
+      return r.res;
+    }
+    if (r.res != -EINVAL) {
+      _SysErrnoSet() = -r.res;
+      return r.res;
+    }
+    fallback = true;                            // kernel before 5.19
+  }
+  return ring.syncIO(io_uring_prep_accept, fd, addr, addrlen, flags);
+}
+
+inline ssize_t UringMultishot::recv(IOUring& ring, int fd, void* buf, size_t len) {
+  if (!fallback) {
+    Result r = next(ring, fd);
+    if (r.res > 0) {
+      size_t n = std::min(len, size_t(r.res - r.offset));
+      memcpy(buf, r.ring->bufAddr(r.bid) + r.offset, n);
+      r.offset += n;
+      if (r.offset < r.res) requeue(r);
+      else giveBack(r);
+      return n;
+    }
+    if (r.res == 0) return 0;
+    if (r.res != -EINVAL && r.res != -ENOBUFS) {
+      _SysErrnoSet() = -r.res;
+      return r.res;
+    }
+    if (r.res == -EINVAL) fallback = true;      // disarmed, or kernel before 6.0
+    // ENOBUFS: all buffers in use -> receive directly into caller's buffer
+  }
+  struct iovec iov = { buf, len };
+  ssize_t ret;
+  if (take(&iov, 1, false, ret)) return ret;    // queued before disarm()
+  return ring.syncIO(io_uring_prep_recv, fd, buf, len, 0);
+}
+
+// input other than recv(): false -> caller issues single-shot request
+inline bool UringMultishot::input(const struct iovec* iov, int cnt, bool peek, ssize_t& ret) {
+  if (acceptor) return false;
+  size_t total = 0;
+  for (int v = 0; v < cnt; v += 1) total += iov[v].iov_len;
+  if (total == 0) return false;                 // nothing to overtake
+  disarm();
+  return take(iov, cnt, peek, ret);
+}
+
+inline void UringMultishot::close() {
+  std::deque<Result> drop;
+  lock.acquire();
+  closed = true;
+  bool active = armed;
+  drop.swap(results);
+  lock.release();
+  for (const Result& r : drop) discard(r);
+  if (active) cancel();                         // before fd can be reused
+  release();
+}
+#endif
+
 #endif /* _IOUring_h_ */
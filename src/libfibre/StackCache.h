@@ -0,0 +1,108 @@
+/******************************************************************************
+    Copyright (C) Martin Karsten 2015-2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#ifndef _StackCache_h_
+#define _StackCache_h_ 1
+
+#include "runtime/Basics.h"
+
+/*
+Cache of mapped and guarded fibre stacks.  Each worker keeps a private
+list per size class, backed by a global overflow pool.  A local list that
+reaches its high-water mark spills half of its stacks to the global pool,
+and the global pool unmaps stacks beyond its own limit.  Only stacks with
+the default guard and a size of DefaultStackSize << class are cached.
+Limits are set at bootstrap: FibreStackCache (per worker and class) and
+FibreStackCacheGlobal (per class); 0 disables the respective level.
+
+FibreStackReclaim sets a watermark (bytes below the stack top).  When a
+stack is cached after its fibre has used memory below the watermark, the
+pages below are released with MADV_FREE, so that idle cached stacks do
+not pin their peak usage.  MADV_FREE pages only leave RSS under memory
+pressure; a trailing 'd' (e.g., 16384d) selects MADV_DONTNEED instead,
+which drops pages immediately at the cost of zero-fill faults on reuse.  Deep use is detected through
+a marker word right below the watermark: it reads as zero, unless a fibre
+has written to it.  The marker's page is not released, so resetting the
+marker does not fault it back in.
+
+FibreStackArena sets a chunk size in 2MB pages and enables stack arenas:
+cacheable stacks are carved from 2MB-aligned chunks that are marked for
+transparent huge pages, instead of mapping each stack separately.  This
+reduces VMA count and TLB pressure.  Arena slots are never unmapped; free
+slots are kept in a lock-free stack per class.  The guard area of a slot
+is not protected (that would split huge pages), but filled with canary
+words that are checked when the stack is returned.  An overflow can thus
+corrupt the top of the slot below before it is detected, so Fibre::create()
+does not co-locate fibre objects on arena stacks.  Page reclamation via
+FibreStackReclaim also splits huge pages and should not be combined.
+*/
+class StackCache {
+public:
+  static const size_t Classes = 4;
+  static const size_t DefaultLocalLimit  = 16;
+  static const size_t DefaultGlobalLimit = 256;
+
+private:
+  struct Link { Link* next; };
+  struct List { // stacks (top address) linked through their topmost word
+    Link*  head = nullptr;
+    size_t count = 0;
+    void push(vaddr top) { Link* l = (Link*)top - 1; l->next = head; head = l; count += 1; }
+    vaddr pop() { Link* l = head; head = l->next; count -= 1; return vaddr(l + 1); }
+  };
+  List local[Classes];
+
+  static size_t localLimit;
+  static size_t globalLimit;
+  static List   global[Classes];
+  static size_t reclaimMark; // 0 = no reclamation
+
+  struct Arena {
+    volatile uintptr_t top = 0; // free slots (top address), tagged (see ParkingStack)
+    vaddr next = 0;             // carve position in current chunk
+    vaddr limit = 0;            // end of current chunk
+  };
+  static const size_t ArenaPage = 2 * 1024 * 1024;
+  static const size_t TagShift = 48;
+  static size_t arenaChunk;   // bytes, 0 = no arena
+  static Arena  arena[Classes];
+
+  static vaddr  arenaAlloc(size_t c, size_t size, size_t guard);
+  static void   arenaFree(size_t c, vaddr top);
+  static void   arenaCheck(vaddr bottom, size_t size, size_t guard);
+
+  static size_t sizeClass(size_t size, size_t guard);
+  static List*  localList(size_t c);
+  static void   reclaim(vaddr top, size_t size);
+
+public:
+  /** Map stack of 'size' bytes plus 'guard' bytes and return bottom (guard) address. */
+  static vaddr alloc(size_t size, size_t guard);
+  /** Return stack, as obtained from alloc(), to cache or unmap it. */
+  static void  release(vaddr bottom, size_t size, size_t guard);
+  /** Whether stack guards are protected pages (not canaries in an arena). */
+  static bool  guarded() { return arenaChunk == 0; }
+  /** Check canary of arena stack, called by fibre at exit on its own stack. */
+  static void  check(vaddr bottom, size_t size, size_t guard) {
+    if (arenaChunk) arenaCheck(bottom, size, guard);
+  }
+  /** Set per-worker and global limits (per class), reclamation
+      watermark (bytes, 0 = off), and arena chunk size (2MB pages,
+      0 = off), called during bootstrap. */
+  static void  init(size_t l, size_t g, size_t r, bool dontneed, size_t a);
+};
+
+#endif /* _StackCache_h_ */
@@ -200,12 +200,12 @@ inline int fibre_attr_getdetachstate(const fibre_attr_t *attr, int *detachstate)
 inline int fibre_create(fibre_t *thread, const fibre_attr_t *attr, void *(*start_routine) (void *), void *arg) {
   Fibre* f;
   if (!attr) {
-    f = new Fibre;
+    f = Fibre::create();
   } else {
-    f = new Fibre(*attr->cluster, attr->stackSize, attr->guardSize);
+    f = Fibre::create(*attr->cluster, attr->stackSize, attr->guardSize);
     f->setPriority(Fibre::Priority(attr->priority));
     f->setAffinity(attr->affinity);
-    if (attr->detached) f->detach();
+    if (attr->detached) f->detachDelete();
   }
   *thread = f->run(start_routine, arg);
   return 0;
@@ -220,7 +220,7 @@ inline int fibre_join(fibre_t thread, void **retval) {
 
 /** @brief Detach fibre. (`pthread_detach`) */
 inline int fibre_detach(fibre_t thread) {
-  thread->detach();
+  thread->detachDelete();
   return 0;
 }
 
@@ -247,25 +247,25 @@ inline int fibre_yield(void) {
 
 /** @brief Create key for thread-specific storage. (`pthread_key_create`) */
 inline int fibre_key_create(fibre_key_t *key, void (*destructor)(void*)) {
-  *key = Fibre::key_create(destructor);
+  *key = (fibre_key_t)FibreKey::create(destructor);
   return 0;
 }
 
 /** @brief Delete key for thread-specific storage. (`pthread_key_delete`) */
 inline int fibre_key_delete(fibre_key_t key) {
-  Fibre::key_delete(key);
+  ((FibreKey*)key)->remove();
   return 0;
 }
 
 /** @brief Store thread-specific value. (`pthread_setspecific`) */
 inline int fibre_setspecific(fibre_key_t key, const void *value) {
-  CurrFibre()->setspecific(key, value);
+  ((FibreKey*)key)->set(CurrFibre(), value);
   return 0;
 }
 
 /** @brief Read thread-specific value for key. (`pthread_getspecific`) */
 inline void *fibre_getspecific(fibre_key_t key) {
-  return CurrFibre()->getspecific(key);
+  return ((FibreKey*)key)->get(CurrFibre());
 }
 
 /** @brief Park fibre (indefinite sleep). */
@@ -35,6 +35,8 @@ namespace Context {
   // CurrFred() and CurrProcessor() needed for generic runtime code
   Fred*          CurrFred()       __no_inline;
   BaseProcessor& CurrProcessor()  __no_inline;
+  // CurrProcessorOrNull() can be called from non-worker threads, e.g., pollers
+  BaseProcessor* CurrProcessorOrNull() __no_inline;
   // CurrCluster(), CurrEventScope() only used in libfibre code
   Cluster&       CurrCluster()    __no_inline;
   EventScope&    CurrEventScope() __no_inline;
@@ -48,4 +48,9 @@ inline void RuntimeFredDestroy(Fred& prevFred, _friend<Fred> fs) {
   prevFibre.destroy(fs);
 }
 
+// worker about to park: delete terminated detached fibres, see Fibre::detachDelete()
+inline void RuntimeIdleReap(_friend<BaseProcessor> fs) {
+  Fibre::reap(fs);
+}
+
 #endif /* _RuntimeFred_h_ */
@@ -21,9 +21,45 @@
 #include "libfibre/OsLocks.h"
 
 #if defined(WORKER_LOCK_TYPE)
-typedef WORKER_LOCK_TYPE WorkerLock;
+typedef WORKER_LOCK_TYPE BaseWorkerLock;
 #else
-typedef OsLock<0,0,0> WorkerLock;
+typedef OsLock<0,0,0> BaseWorkerLock;
+#endif
+
+#if TESTING_PREEMPTION
+#include "runtime-glue/RuntimePreemption.h"
+
+// lock holder must not be preempted: the next fred on the same worker
+// could otherwise block or spin on the lock and stall the worker
+template<typename Lock>
+class PreemptionLock : public Lock {
+public:
+  bool tryAcquire() {
+    RuntimeLockPreemption();
+    if (Lock::tryAcquire()) return true;
+    RuntimeUnlockPreemption();
+    return false;
+  }
+  void acquire() {
+    RuntimeLockPreemption();
+    Lock::acquire();
+  }
+  template<typename T>
+  bool acquire(const T& timeout) {
+    RuntimeLockPreemption();
+    if (Lock::acquire(timeout)) return true;
+    RuntimeUnlockPreemption();
+    return false;
+  }
+  void release() {
+    Lock::release();
+    RuntimeUnlockPreemption();
+  }
+};
+
+typedef PreemptionLock<BaseWorkerLock> WorkerLock;
+#else
+typedef BaseWorkerLock WorkerLock;
 #endif
 typedef OsSemaphore   WorkerSemaphore;
 
@@ -17,9 +17,35 @@
 #ifndef _RuntimePreemption_h_
 #define _RuntimePreemption_h_ 1
 
+#include "runtime/Basics.h"
+
+#if TESTING_PREEMPTION
+
+// routine definitions are in Cluster.cc - 'noinline' needed for TLS, since
+// disable/enable brackets can span a fred switch (see RuntimeContext.h)
+
+// per-worker brackets around runtime code
+void RuntimeDisablePreemption() __no_inline;
+void RuntimeEnablePreemption()  __no_inline;
+bool RuntimePreemptionEnabled() __no_inline;
+
+// per-fred brackets while holding worker lock (can span suspension)
+void RuntimeLockPreemption()    __no_inline;
+void RuntimeUnlockPreemption()  __no_inline;
+
+#if TESTING_ENABLE_ASSERTIONS
+#define CHECK_PREEMPTION(x) RASSERT(RuntimePreemptionEnabled() == bool(x), x)
+#else
+#define CHECK_PREEMPTION(x)
+#endif
+
+#else
+
 #define CHECK_PREEMPTION(x)
 
 inline void RuntimeDisablePreemption() {}
 inline void RuntimeEnablePreemption()  {}
 
+#endif
+
 #endif /* _RuntimePreemption_h_ */
@@ -15,15 +15,26 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 #include "runtime/Scheduler.h"
+#include "runtime-glue/RuntimeFred.h"
 
+// idle fred as result: tasks are queued locally, see idleLoop()
 inline Fred* BaseProcessor::searchAll() {
   Fred* nextFred;
+#if TESTING_IO_URING_ADAPTIVE
+  RuntimeWorkerFlush(*this); // submission deadline, see IOUring.h
+#endif
+#if TESTING_STACKLESS_TASKS
+  if (taskCount) return idleFred;
+#endif
   if ((nextFred = searchLocal())) return nextFred;
 #if TESTING_LOADBALANCING
   if (RuntimeWorkerPoll(*this)) {
     if ((nextFred = searchLocal())) return nextFred;
   }
   if ((nextFred = searchSteal())) return nextFred;
+#endif
+#if TESTING_STACKLESS_TASKS
+  if (searchStealTasks()) return idleFred;
 #endif
   return nullptr;
 }
@@ -39,18 +50,132 @@ inline Fred* BaseProcessor::searchLocal() {
 
 #if TESTING_LOADBALANCING
 inline Fred* BaseProcessor::searchSteal() {
-  BaseProcessor* victim = ProcessorRing::next(*this);
-  for (;;) {
-    if (victim == this) return nullptr;
-    Fred* f = victim->readyQueue.tryDequeue();
-    if (f) {
-      DBG::outl(DBG::Level::Scheduling, "searchSteal: ", FmtHex(this), "<-", FmtHex(victim), ' ', FmtHex(f));
-      if (f->checkAffinity(*this, _friend<BaseProcessor>())) stats->borrow.count();
-      else stats->steal.count();
-      return f;
+  // nearby levels: precomputed victims only, randomized start point
+  for (size_t level = 0; level < StealRemote; level += 1) {
+    size_t count = stealVictimCount[level];
+    if (!count) continue;
+    size_t start = stealRandom() % count;
+    for (size_t i = 0; i < count; i += 1) {
+      Fred* f = stealFrom(stealVictims[level][(start + i) % count], level);
+      if (f) return f;
+    }
+  }
+  return searchStealLevel(StealRemote, scheduler.processorCount());
+}
+
+inline Fred* BaseProcessor::stealFrom(BaseProcessor* victim, size_t level) {
+  if (!victim || victim == this || distance(*victim) != level) return nullptr;
+  Fred* batch[StealBatchMax];
+  size_t count = victim->readyQueue.tryDequeueBatch(batch, StealBatchMax);
+  if (!count) return nullptr;
+  // pinned freds go back to victim without borrowing
+  size_t first = 0;
+  for (; first < count && batch[first]->isPinned(); first += 1) victim->enqueueFred(*batch[first]);
+  bool returned = first > 0;
+  Fred* f = nullptr;
+  if (first < count) {
+    f = batch[first];
+    DBG::outl(DBG::Level::Scheduling, "searchSteal: ", FmtHex(this), "<-", FmtHex(victim), ' ', FmtHex(f), ' ', count, '/', level);
+    if (f->checkAffinity(*this, _friend<BaseProcessor>())) stats->borrow.count();
+    else stats->steal.count();
+    // move the rest of the batch to the local queue, freds with affinity go back to victim
+    for (size_t i = first + 1; i < count; i += 1) {
+      if (batch[i]->checkAffinity(*this, _friend<BaseProcessor>())) {
+        victim->enqueueFred(*batch[i]);
+        returned = true;
+      } else {
+        enqueueFred(*batch[i]);
+      }
     }
+    stats->stealBatch.count(count);
+    stats->stealLevel[level].count();
+  }
+#if TESTING_GO_IDLEMANAGER
+  // victim might have parked since the batch was taken
+  if (returned) scheduler.idleManager.unblockTarget(*victim);
+#else
+  (void)returned; // IdleManager only hands over freds, no targeted wake-up
+#endif
+  return f;
+}
+
+#if TESTING_OCCUPANCY_BITMAP
+inline Fred* BaseProcessor::searchStealLevel(size_t level, size_t) {
+  // only visit processors marked in occupancy bitmap, starting at random index
+  size_t start = stealRandom() % scheduler.getOccupancyCount();
+  for (size_t idx = scheduler.findOccupied(start); idx != limit<size_t>(); idx = scheduler.findOccupied(idx + 1)) {
+    Fred* f = stealFrom(scheduler.getOccupied(idx), level);
+    if (f) return f;
+  }
+  for (size_t idx = scheduler.findOccupied(0); idx < start; idx = scheduler.findOccupied(idx + 1)) {
+    Fred* f = stealFrom(scheduler.getOccupied(idx), level);
+    if (f) return f;
+  }
+  return nullptr;
+}
+#else
+inline Fred* BaseProcessor::searchStealLevel(size_t level, size_t procCount) {
+  // randomized start point, so that thieves do not all hit the same victim
+  BaseProcessor* victim = this;
+  for (size_t i = stealRandom() % procCount; i > 0; i -= 1) victim = ProcessorRing::next(*victim);
+  BaseProcessor* start = victim;
+  do {
+    Fred* f = stealFrom(victim, level);
+    if (f) return f;
     victim = ProcessorRing::next(*victim);
+  } while (victim != start);
+  return nullptr;
+}
+#endif
+#endif
+
+#if TESTING_STACKLESS_TASKS
+// caller must hold taskLock
+size_t BaseProcessor::dequeueTasks(Task** batch, size_t max) {
+  size_t count = 0;
+  while (count < max && (batch[count] = taskQueue.pop())) count += 1;
+  if (count) __atomic_sub_fetch(&taskCount, count, __ATOMIC_RELAXED);
+  return count;
+}
+
+// run one batch of local tasks on idle stack
+inline bool BaseProcessor::runTasks() {
+  if (!taskCount) return false;
+  Task* batch[TaskBatchMax];
+  size_t count;
+  {
+    ScopedLock<WorkerLock> sl(taskLock);
+    count = dequeueTasks(batch, TaskBatchMax);
   }
+  taskRunning = true;
+  for (size_t i = 0; i < count; i += 1) batch[i]->run();
+  taskRunning = false;
+  stats->task.count(count);
+  return count;
+}
+
+// move up to half of a victim's tasks to local queue
+inline bool BaseProcessor::searchStealTasks() {
+  BaseProcessor* victim = this;
+  for (size_t i = stealRandom() % scheduler.processorCount(); i > 0; i -= 1) victim = ProcessorRing::next(*victim);
+  BaseProcessor* start = victim;
+  do {
+    size_t length = victim->taskCount;
+    if (victim != this && length && victim->taskLock.tryAcquire()) {
+      Task* batch[TaskBatchMax];
+      size_t limit = (length + 1) / 2 < TaskBatchMax ? (length + 1) / 2 : TaskBatchMax;
+      size_t count = victim->dequeueTasks(batch, limit);
+      victim->taskLock.release();
+      for (size_t i = 0; i < count; i += 1) enqueueTask(*batch[i]);
+      if (count) {
+        DBG::outl(DBG::Level::Scheduling, "searchStealTasks: ", FmtHex(this), "<-", FmtHex(victim), ' ', count);
+        stats->taskSteal.count(count);
+        return true;
+      }
+    }
+    victim = ProcessorRing::next(*victim);
+  } while (victim != start);
+  return false;
 }
 #endif
 
@@ -74,27 +199,126 @@ inline Fred* BaseProcessor::scheduleNonblocking() {
   return scheduleBlocking();
 }
 
+// spin about twice the typical idle gap, but only if work usually arrives within the limit
+inline long long BaseProcessor::idleSpinBudget() {
+  long long limit = scheduler.getIdleSpin();
+  long long budget = (idleGapNS > limit) ? IdleSpinMinNS : 2 * idleGapNS + IdleSpinMinNS;
+  if (budget > limit) budget = limit;
+  haltSpin = (idleGapNS > limit) ? 0 : HaltSpinMax;
+  return budget;
+}
+
+inline void BaseProcessor::idleFound(const Time& start) {
+  long long gap = (Runtime::Timer::now() - start).toNS();
+  idleGapNS += (gap - idleGapNS) / 8;
+  idleEnd(gap);
+}
+
+// publish idle period for elastic controller, see Cluster::elasticLoop()
+inline void BaseProcessor::idleBegin(const Time& start) {
+#if TESTING_ELASTIC_WORKERS
+  __atomic_store_n(&idleSince, start.toNS(), __ATOMIC_RELAXED);
+#else
+  (void)start;
+#endif
+}
+
+inline void BaseProcessor::idleEnd(long long gap) {
+#if TESTING_ELASTIC_WORKERS
+  __atomic_store_n(&idleSince, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&idleNS, idleNS + gap, __ATOMIC_RELAXED);
+#else
+  (void)gap;
+#endif
+}
+
+#if TESTING_ELASTIC_WORKERS
+
+// retired by scheduler: pass on queued freds, then wait for reactivation - a
+// concurrent enqueue that finds the processor retired posts 'retireSem' again;
+// a fred with affinity is not moved: the processor is reactivated to run it
+inline Fred* BaseProcessor::retire() {
+  DBG::outl(DBG::Level::Scheduling, "retire: ", FmtHex(this));
+  stats->retire.count();
+  while (isRetired()) {
+    for (;;) {
+      Fred* f = readyQueue.dequeue();
+      if (!f) break;
+      if (f->getAffinity()) {
+        scheduler.cancelRetire(*this, _friend<BaseProcessor>());
+        DBG::outl(DBG::Level::Scheduling, "reactivate (affinity): ", FmtHex(this));
+        return f;
+      }
+      BaseProcessor& target = nextPlacement();
+      f->rehome(target, _friend<BaseProcessor>());
+      target.enqueueFred(*f);
+      scheduler.idleManager.unblock(&target);
+    }
+#if TESTING_STACKLESS_TASKS
+    for (;;) {
+      Task* batch[TaskBatchMax];
+      size_t count;
+      {
+        ScopedLock<WorkerLock> sl(taskLock);
+        count = dequeueTasks(batch, TaskBatchMax);
+      }
+      if (!count) break;
+      for (size_t i = 0; i < count; i += 1) {
+        BaseProcessor& target = nextPlacement();
+        target.enqueueTask(*batch[i]);
+        scheduler.idleManager.unblock(&target);
+      }
+    }
+#endif
+    retireSem.P();
+  }
+  DBG::outl(DBG::Level::Scheduling, "reactivate: ", FmtHex(this));
+  return nullptr;
+}
+
+#endif
+
 #if TESTING_LOADBALANCING && TESTING_GO_IDLEMANAGER
 
 inline Fred& BaseProcessor::scheduleIdle() {
   Fred* nextFred;
+  Time start = Runtime::Timer::now(); // idle gap, including time parked
+  Time spin = start;                  // current spin window
+  idleBegin(start);
   for (;;) {
+    Time end = spin + Time::fromNS(idleSpinBudget());
     scheduler.idleManager.incSpinning();
-    for (size_t i = 1; i < IdleSpinMax; i += 1) {
+    do {
       nextFred = searchAll();
       if (nextFred) {
         scheduler.idleManager.unblockSpin();
+        stats->spinHit.count();
+        idleFound(start);
         return *nextFred;
       }
-    }
+    } while (Runtime::Timer::now() < end);
+    stats->spinMiss.count();
     scheduler.idleManager.decSpinning();
+#if TESTING_ELASTIC_WORKERS
+    if (scheduler.tryRetire(*this, _friend<BaseProcessor>())) {
+      idleEnd((Runtime::Timer::now() - start).toNS()); // retired time is not idle time
+      nextFred = retire();
+      if (nextFred) return *nextFred;
+      start = spin = Runtime::Timer::now();
+      idleBegin(start);
+      continue;
+    }
+#endif
+    RuntimeIdleReap(_friend<BaseProcessor>());
     scheduler.idleManager.incWaiting();
     nextFred = searchAll();
     if (nextFred) {
       scheduler.idleManager.decWaiting();
+      idleFound(start);
       return *nextFred;
     }
     scheduler.idleManager.block(*this);
+    spin = Runtime::Timer::now();
   }
 }
 
@@ -102,22 +326,33 @@ inline Fred& BaseProcessor::scheduleIdle() {
 
 inline Fred& BaseProcessor::scheduleIdle() {
   Fred* nextFred;
-  for (size_t i = 1; i < IdleSpinMax; i += 1) {
+  Time start = Runtime::Timer::now();
+  Time end = start + Time::fromNS(idleSpinBudget());
+  do {
     nextFred = scheduleNonblocking();
-    if (nextFred) return *nextFred;
-  }
+    if (nextFred) {
+      stats->spinHit.count();
+      idleFound(start);
+      return *nextFred;
+    }
+  } while (Runtime::Timer::now() < end);
+  stats->spinMiss.count();
+  RuntimeIdleReap(_friend<BaseProcessor>());
 #if TESTING_LOADBALANCING
   nextFred = scheduler.idleManager.getReadyFred(*this);
   if (nextFred) {
     DBG::outl(DBG::Level::Scheduling, "handover: ", FmtHex(this), ' ', FmtHex(nextFred));
     nextFred->checkAffinity(*this, _friend<BaseProcessor>());
     stats->handover.count();
+    idleFound(start);
     return *nextFred;
   }
 #else  /* TESTING_LOADBALANCING */
   if (!readyCount.P()) haltSem.P(*this);
 #endif /* TESTING_LOADBALANCING */
-  return *scheduleBlocking();
+  nextFred = scheduleBlocking();
+  idleFound(start);
+  return *nextFred;
 }
 
 #endif /* TESTING_LOADBALANCING && TESTING_GO_IDLEMANAGER */
@@ -125,7 +360,18 @@ inline Fred& BaseProcessor::scheduleIdle() {
 void BaseProcessor::idleLoop(Fred* initFred) {
   if (initFred) Fred::idleYieldTo(*initFred, _friend<BaseProcessor>());
   for (;;) {
+#if TESTING_STACKLESS_TASKS
+    // serve local ready fred between task batches
+    if (runTasks()) {
+      Fred* nextFred = searchLocal();
+      if (nextFred) Fred::idleYieldTo(*nextFred, _friend<BaseProcessor>());
+      continue;
+    }
+#endif
     Fred& nextFred = scheduleIdle();
+#if TESTING_STACKLESS_TASKS
+    if (&nextFred == idleFred) continue;
+#endif
     Fred::idleYieldTo(nextFred, _friend<BaseProcessor>());
   }
 }
@@ -145,17 +391,17 @@ Fred& BaseProcessor::scheduleFull(_friend<Fred>) {
   return nextFred ? *nextFred : *idleFred;
 }
 
-void BaseProcessor::enqueueResume(Fred& f, BaseProcessor&proc, _friend<Fred>) {
+void BaseProcessor::enqueueResume(Fred& f, BaseProcessor&proc, bool runNext, _friend<Fred>) {
 #if TESTING_LOADBALANCING
 #if TESTING_GO_IDLEMANAGER
-  enqueueFred(f);
+  enqueueFred(f, runNext);
   scheduler.idleManager.unblock(&proc);
 #else
-  if (!scheduler.idleManager.addReadyFred(f, proc)) enqueueFred(f);
+  if (!scheduler.idleManager.addReadyFred(f, proc)) enqueueFred(f, runNext);
 #endif
 #else
   (void)proc;
-  enqueueFred(f);
+  enqueueFred(f, runNext);
   if (!readyCount.V()) haltSem.V(*this);
 #endif
 }
@@ -18,28 +18,63 @@
 #define _BaseProcessor_h_ 1
 
 #include "runtime/Benaphore.h"
+#include "runtime/Bitmap.h"
 #include "runtime/Debug.h"
 #include "runtime/Fred.h"
 #include "runtime/HaltSemaphore.h"
 #include "runtime/Stats.h"
+#if TESTING_STACKLESS_TASKS
+#include "runtime/Task.h"
+#endif
+#include "runtime-glue/RuntimeContext.h"
+#include "runtime-glue/RuntimeTimer.h"
 
 class BaseProcessor;
 class IdleManager;
+class ParkingStack;
 class Scheduler;
 
+#if TESTING_OCCUPANCY_BITMAP
+typedef HierarchicalBitmap<12> OccupancyBitmap; // up to 4096 processors per scheduler
+#endif
+
 class ReadyQueue {
   WorkerLock readyLock;
-  FredReadyQueue queue[Fred::NumPriority];
+  FredReadyQueue queue[Fred::NumPriority]; // MPSC inbox for remote enqueue, if deque is used
+#if TESTING_WORKSTEALING_DEQUE
+  FredDeque deque[Fred::NumPriority];      // owner enqueue and dequeue without readyLock
+#endif
+#if TESTING_LOADBALANCING
+  volatile size_t inboxCount = 0;          // upper bound on inbox length, used for batch stealing
+#endif
+#if TESTING_RUNNEXT
+  static const size_t RunNextMax = 8;      // consecutive run-next picks before queue is served
+  Fred* volatile runNext = nullptr;        // single slot, filled by any thread, taken by owner or thief
+  size_t         runNextStreak = 0;        // owner only
+#endif
+
+#if TESTING_OCCUPANCY_BITMAP
+  OccupancyBitmap* occupancy = nullptr;    // scheduler-wide summary: bit set -> queue likely not empty
+  size_t           occupancyIndex = 0;
+#endif
 
   FredStats::ReadyQueueStats* stats;
 
   ReadyQueue(const ReadyQueue&) = delete;            // no copy
   ReadyQueue& operator=(const ReadyQueue&) = delete; // no assignment
 
+  Fred* popInbox(size_t p) {
+    Fred* f = queue[p].pop();
+#if TESTING_LOADBALANCING
+    if (f) __atomic_sub_fetch(&inboxCount, 1, __ATOMIC_RELAXED);
+#endif
+    return f;
+  }
+
   template<bool Try = false>
   Fred* dequeueInternal() {
     for (size_t p = 0; p < Fred::NumPriority; p += 1) {
-      Fred* f = queue[p].pop();
+      Fred* f = popInbox(p);
       if (f) return f;
     }
     if (Try) stats->queue.tryfail();
@@ -47,44 +82,223 @@ class ReadyQueue {
     return nullptr;
   }
 
-  bool probe() {
+  bool probeInbox() {
     for (size_t p = 0; p < Fred::NumPriority; p += 1) {
       if (!queue[p].empty<true>()) return true;
     }
     return false;
   }
 
-public:
-  ReadyQueue(BaseProcessor& bp) { stats = new FredStats::ReadyQueueStats(this, &bp); }
+#if TESTING_WORKSTEALING_DEQUE
+  Fred* dequeueDeque() {
+    for (size_t p = 0; p < Fred::NumPriority; p += 1) {
+      Fred* f = deque[p].steal();
+      if (f) return f;
+    }
+    return nullptr;
+  }
 
-  Fred* dequeue() {
+  // owner only, caller must hold readyLock
+  void transferInbox() {
+    for (size_t p = 0; p < Fred::NumPriority; p += 1) {
+      while (!deque[p].full()) {
+        Fred* f = popInbox(p);
+        if (!f) break;
+        bool success = deque[p].push(*f);
+        RASSERT0(success);
+      }
+    }
+  }
+
+  bool probeQueue() {
+    for (size_t p = 0; p < Fred::NumPriority; p += 1) {
+      if (!deque[p].empty()) return true;
+    }
+    return probeInbox();
+  }
+#else
+  bool probeQueue() { return probeInbox(); }
+#endif
+
+#if TESTING_RUNNEXT
+  bool probe() { return runNext || probeQueue(); }
+
+  Fred* dequeueNext() {
+    if (!runNext) return nullptr;
+    Fred* f = __atomic_exchange_n(&runNext, nullptr, __ATOMIC_SEQ_CST);
+    if (f) stats->queue.remove();
+    return f;
+  }
+#else
+  bool probe() { return probeQueue(); }
+#endif
+
+#if TESTING_OCCUPANCY_BITMAP
+  // producer: set after push, only touch the shared bitmap when bit is clear
+  // fence pairs with vacated(): push -> test vs. clear -> probe
+  void occupied() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!occupancy->test(occupancyIndex)) occupancy->set<true>(occupancyIndex);
+  }
+  // consumer: clear when found empty, re-check to not miss a concurrent push
+  void vacated() {
+    if (!occupancy->test(occupancyIndex)) return;
+    occupancy->clr<true>(occupancyIndex);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (probe()) occupied();
+  }
+#endif
+
+  Fred* dequeueQueue() {
+#if TESTING_WORKSTEALING_DEQUE
+    // transfer after dequeue: a full deque must not starve the inbox
+    Fred* f = dequeueDeque();
+    if (probeInbox()) {
+      ScopedLock<WorkerLock> sl(readyLock);
+      transferInbox();
+      if (!f) f = dequeueDeque();
+    }
+    if (!f) stats->queue.fail();
+#else
 #if TESTING_LOADBALANCING
     ScopedLock<WorkerLock> sl(readyLock);
 #endif
     Fred* f = dequeueInternal();
+#endif
     stats->queue.remove((int)(bool)f);
     return f;
   }
 
+public:
+  ReadyQueue(BaseProcessor& bp) { stats = new FredStats::ReadyQueueStats(this, &bp); }
+
+  Fred* dequeue() {
+#if TESTING_RUNNEXT
+    // run-next slot first, but serve the queue after RunNextMax consecutive picks
+    if (runNextStreak < RunNextMax) {
+      Fred* f = dequeueNext();
+      if (f) {
+        runNextStreak += 1;
+        return f;
+      }
+    }
+    runNextStreak = 0;
+    Fred* f = dequeueQueue();
+    if (!f) f = dequeueNext();
+#else
+    Fred* f = dequeueQueue();
+#endif
+#if TESTING_OCCUPANCY_BITMAP
+    if (!f) vacated();
+#endif
+    return f;
+  }
+
 #if TESTING_LOADBALANCING
+  // approximate number of queued freds, excluding run-next slot
+  size_t queueLength() const {
+    size_t length = __atomic_load_n(&inboxCount, __ATOMIC_RELAXED);
+#if TESTING_WORKSTEALING_DEQUE
+    for (size_t p = 0; p < Fred::NumPriority; p += 1) length += deque[p].size();
+#endif
+    return length;
+  }
+
   Fred* tryDequeue() {
     if (!probe()) return nullptr;
+    Fred* f;
+#if TESTING_WORKSTEALING_DEQUE
+    f = dequeueDeque();
+    if (f) {
+      stats->queue.remove();
+      return f;
+    }
+#endif
     if (!readyLock.tryAcquire()) return nullptr;
-    Fred* f = dequeueInternal<true>();
+    f = dequeueInternal<true>();
     stats->queue.remove((int)(bool)f);
     readyLock.release();
     return f;
   }
+
+  // take up to half of the queued freds (at most 'max') in one locked operation
+  size_t tryDequeueBatch(Fred** batch, size_t max) {
+    if (!probe()) {
+#if TESTING_OCCUPANCY_BITMAP
+      vacated();
+#endif
+      return 0;
+    }
+    if (!readyLock.tryAcquire()) return 0;
+    size_t length = queueLength();
+    size_t limit = (length + 1) / 2 < max ? (length + 1) / 2 : max;
+    size_t count = 0;
+    for (size_t p = 0; p < Fred::NumPriority && count < limit; p += 1) {
+#if TESTING_WORKSTEALING_DEQUE
+      while (count < limit && (batch[count] = deque[p].steal())) count += 1;
+#endif
+      while (count < limit && (batch[count] = popInbox(p))) count += 1;
+    }
+    stats->queue.remove(count);
+    readyLock.release();
+#if TESTING_RUNNEXT
+    // owner is busy, if run-next fred is still there and queue empty
+    if (count == 0 && (batch[0] = dequeueNext())) count = 1;
+#endif
+    if (count == 0) stats->queue.tryfail();
+    return count;
+  }
 #endif
 
-  void enqueue(Fred& f) {
+  void enqueue(Fred& f, bool local = false) {
     RASSERT(f.getPriority() < Fred::NumPriority, f.getPriority());
+#if TESTING_WORKSTEALING_DEQUE
+    if (local && deque[f.getPriority()].push(f)) {
+      stats->queue.add();
+#if TESTING_OCCUPANCY_BITMAP
+      occupied();
+#endif
+      return;
+    }
+#else
+    (void)local;
+#endif
+#if TESTING_LOADBALANCING
+    __atomic_add_fetch(&inboxCount, 1, __ATOMIC_RELAXED); // before push: never below inbox length
+#endif
 #if TESTING_LOCKED_READYQUEUE
     ScopedLock<WorkerLock> sl(readyLock);
 #endif
     queue[f.getPriority()].push(f);
     stats->queue.add();
+#if TESTING_OCCUPANCY_BITMAP
+    occupied();
+#endif
+  }
+
+#if TESTING_RUNNEXT
+  // displaced fred goes to regular queue
+  void enqueueNext(Fred& f, bool local = false) {
+    RASSERT(f.getPriority() < Fred::NumPriority, f.getPriority());
+    Fred* prev = __atomic_exchange_n(&runNext, &f, __ATOMIC_SEQ_CST);
+    stats->queue.add();
+    if (prev) {
+      stats->queue.remove();
+      enqueue(*prev, local);
+#if TESTING_OCCUPANCY_BITMAP
+    } else {
+      occupied();
+#endif
+    }
+  }
+#endif
+
+#if TESTING_OCCUPANCY_BITMAP
+  void setOccupancy(OccupancyBitmap& bm, size_t idx) {
+    occupancy = &bm;
+    occupancyIndex = idx;
   }
+#endif
 
   void reset(BaseProcessor& bp, _friend<EventScope>) {
     new (stats) FredStats::ReadyQueueStats(this, &bp);
@@ -96,33 +310,126 @@ typedef IntrusiveList<BaseProcessor,0,2> ProcessorList;
 typedef IntrusiveRing<BaseProcessor,1,2> ProcessorRing;
 
 class BaseProcessor : public DoubleLink<BaseProcessor,2> {
+public:
+  // victim levels for work stealing: SMT siblings, shared LLC, NUMA node, remote
+  enum StealLevel { StealCore = 0, StealCache = 1, StealNode = 2, StealRemote = 3, NumStealLevels = FredStats::ProcessorStats::StealLevels };
+  static_assert(StealRemote + 1 == NumStealLevels, "steal levels out of sync with ProcessorStats");
+
+private:
     friend class Fred;
     ReadyQueue readyQueue;
 
     static const size_t HaltSpinMax = 64;
-    static const size_t IdleSpinMax = 1024;
+    static const long long IdleSpinMinNS = 1000;
+#if TESTING_LOADBALANCING
+    static const size_t StealBatchMax = 32;
+#endif
 
     inline Fred* searchAll();
     inline Fred* searchLocal();
 #if TESTING_LOADBALANCING
+  size_t         topology[StealRemote]; // cpu topology ids per level, limit<size_t>() if unknown
+  BaseProcessor** stealVictims[StealRemote]; // processors at exactly this distance, see setStealVictims()
+  size_t         stealVictimCount[StealRemote];
+  size_t         stealSeed;
   inline Fred*   searchSteal();
+  inline Fred*   searchStealLevel(size_t level, size_t procCount);
+  inline Fred*   stealFrom(BaseProcessor* victim, size_t level);
+  StealLevel distance(const BaseProcessor& other) const {
+    for (size_t l = 0; l < StealRemote; l += 1) {
+      if (topology[l] != limit<size_t>() && topology[l] == other.topology[l]) return StealLevel(l);
+    }
+    return StealRemote;
+  }
+  size_t stealRandom() { // xorshift
+    stealSeed ^= stealSeed << 13;
+    stealSeed ^= stealSeed >> 7;
+    stealSeed ^= stealSeed << 17;
+    return stealSeed;
+  }
 #else
   Benaphore<>    readyCount;
 #endif
   HaltSemaphore  haltSem;
   Fred*          handoverFred;
+  BaseProcessor* placeCursor;  // round-robin placement, owner only
+  long long      idleGapNS;    // EWMA of idle time until work is found, owner only
+  size_t         haltSpin;
 #if TESTING_WAKE_FRED_WORKER
   bool           halting = false;
 #endif
+#if TESTING_ELASTIC_WORKERS
+  volatile bool      retired = false;
+  volatile long long idleNS = 0;      // completed idle periods (spin and park), owner only
+  volatile long long idleSince = 0;   // start of current idle period, 0 if busy
+  WorkerSemaphore    retireSem;
+#endif
+#if TESTING_STACKLESS_TASKS
+  static const size_t TaskBatchMax = 32;
+  TaskQueue      taskQueue;             // MPSC, consumers hold taskLock
+  WorkerLock     taskLock;
+  volatile size_t taskCount = 0;        // upper bound on queue length
+  bool           taskRunning = false;   // idle fred is executing task, owner only
+  size_t         dequeueTasks(Task** batch, size_t max);
+  void enqueueTask(Task& t) {
+    __atomic_add_fetch(&taskCount, 1, __ATOMIC_RELAXED); // before push: never below queue length
+    taskQueue.push(t);
+#if TESTING_ELASTIC_WORKERS
+    // retired concurrently -> processor hands off task, see retire()
+    if slowpath(__atomic_load_n(&retired, __ATOMIC_SEQ_CST)) retireSem.V();
+#endif
+  }
+  inline bool    runTasks();
+  inline bool    searchStealTasks();
+#endif
+#if TESTING_LOADBALANCING && TESTING_GO_IDLEMANAGER
+  friend class ParkingStack;
+  BaseProcessor* volatile parkNext = nullptr;
+  volatile bool  parkLinked = false;  // physically in ParkingStack
+  volatile bool  parkHalting = false; // parked and not yet claimed by a waker
+#endif
 
-  void enqueueFred(Fred& f) {
+  void enqueueFred(Fred& f, bool runNext = false) {
     DBG::outl(DBG::Level::Scheduling, "Fred ", FmtHex(&f), " queueing on ", FmtHex(this));
-    readyQueue.enqueue(f);
+#if TESTING_WORKSTEALING_DEQUE
+    bool local = Context::CurrProcessorOrNull() == this;
+#else
+    bool local = false;
+#endif
+#if TESTING_RUNNEXT
+    if (runNext) {
+      readyQueue.enqueueNext(f, local);
+      return;
+    }
+#else
+    (void)runNext;
+#endif
+    readyQueue.enqueue(f, local);
+#if TESTING_ELASTIC_WORKERS
+    // retired concurrently -> processor hands off fred, see retire()
+    if slowpath(__atomic_load_n(&retired, __ATOMIC_SEQ_CST)) retireSem.V();
+#endif
   }
 
+  inline long long idleSpinBudget();
+  inline void      idleFound(const Time& start);
+  inline void      idleBegin(const Time& start);
+  inline void      idleEnd(long long gap);
   inline Fred* scheduleBlocking();
   inline Fred* scheduleNonblocking();
   inline Fred& scheduleIdle();
+#if TESTING_ELASTIC_WORKERS
+  inline Fred* retire();
+#endif
+
+  BaseProcessor& nextPlacement() {
+    placeCursor = ProcessorRing::next(*placeCursor);
+#if TESTING_ELASTIC_WORKERS
+    // skip retired processors, at least one is active
+    while (placeCursor->retired) placeCursor = ProcessorRing::next(*placeCursor);
+#endif
+    return *placeCursor;
+  }
 
 protected:
   Scheduler& scheduler;
@@ -133,12 +440,81 @@ protected:
 public:
   FredStats::ProcessorStats* stats;
 
-  BaseProcessor(Scheduler& c, const char* n = "Processor  ") : readyQueue(*this), haltSem(0), handoverFred(nullptr), scheduler(c), idleFred(nullptr) {
+  BaseProcessor(Scheduler& c, const char* n = "Processor  ") : readyQueue(*this), haltSem(0), handoverFred(nullptr), placeCursor(this), idleGapNS(0), haltSpin(HaltSpinMax), scheduler(c), idleFred(nullptr) {
     stats = new FredStats::ProcessorStats(this, &c, n);
+#if TESTING_LOADBALANCING
+    for (size_t l = 0; l < StealRemote; l += 1) {
+      topology[l] = limit<size_t>();
+      stealVictims[l] = nullptr;
+      stealVictimCount[l] = 0;
+    }
+    stealSeed = uintptr_t(this) | 1;
+#endif
+  }
+
+  // ids: first cpu of SMT core, first cpu of last-level cache, NUMA node
+  void setTopology(const size_t ids[StealRemote], _friend<EventScope>) {
+#if TESTING_LOADBALANCING
+    for (size_t l = 0; l < StealRemote; l += 1) topology[l] = ids[l];
+#else
+    (void)ids;
+#endif
+  }
+
+  // after setTopology() for all 'procs': victims per level, so that searchSteal() probes only those
+  void setStealVictims(BaseProcessor* const* procs, size_t count, _friend<EventScope>) {
+#if TESTING_LOADBALANCING
+    for (size_t l = 0; l < StealRemote; l += 1) {
+      delete [] stealVictims[l];
+      stealVictims[l] = nullptr;
+      stealVictimCount[l] = 0;
+      if (topology[l] == limit<size_t>()) continue;
+      for (size_t i = 0; i < count; i += 1) {
+        if (procs[i] != this && distance(*procs[i]) == StealLevel(l)) stealVictimCount[l] += 1;
+      }
+      if (!stealVictimCount[l]) continue;
+      stealVictims[l] = new BaseProcessor*[stealVictimCount[l]];
+      for (size_t i = 0, v = 0; i < count; i += 1) {
+        if (procs[i] != this && distance(*procs[i]) == StealLevel(l)) stealVictims[l][v++] = procs[i];
+      }
+    }
+#else
+    (void)procs;
+    (void)count;
+#endif
   }
 
   Scheduler& getScheduler() { return scheduler; }
 
+  BaseProcessor& advancePlacement(_friend<Scheduler>) { return nextPlacement(); }
+  void resetPlacement(BaseProcessor& removed, _friend<Scheduler>) {
+    if (placeCursor == &removed) placeCursor = ProcessorRing::next(removed);
+    if (placeCursor == &removed) placeCursor = this;
+  }
+
+#if TESTING_ELASTIC_WORKERS
+  bool isRetired() const { return retired; }
+  void setRetired(bool r, _friend<Scheduler>) {
+    __atomic_store_n(&retired, r, __ATOMIC_SEQ_CST);
+    if (!r) retireSem.V();
+  }
+  // completed plus in-progress idle time: sampled without synchronization,
+  // so a period ending concurrently might be missed or counted twice once
+  long long getIdleNS(long long now) const {
+    long long since = __atomic_load_n(&idleSince, __ATOMIC_RELAXED);
+    return __atomic_load_n(&idleNS, __ATOMIC_RELAXED) + (since ? now - since : 0);
+  }
+  size_t getReadyLength() const { return readyQueue.queueLength(); }
+#endif
+
+#if TESTING_STACKLESS_TASKS
+  void enqueueTask(Task& t, _friend<Scheduler>) { enqueueTask(t); }
+#endif
+
+#if TESTING_OCCUPANCY_BITMAP
+  void setOccupancy(OccupancyBitmap& bm, size_t idx, _friend<Scheduler>) { readyQueue.setOccupancy(bm, idx); }
+#endif
+
 #if TESTING_WAKE_FRED_WORKER
   bool isHalting(_friend<IdleManager>) { return halting; }
   void setHalting(bool h, _friend<IdleManager>) { halting = h; }
@@ -148,12 +524,18 @@ public:
 #endif
 
   Fred* halt(_friend<IdleManager>) {
-    for (size_t i = 0; i < HaltSpinMax; i += 1) {
+    for (size_t i = 0; i < haltSpin; i += 1) {
       if fastpath(haltSem.tryP(*this)) return handoverFred;
       Pause();
     }
     stats->idle.count();
+#if TESTING_PARK_STATISTICS
+    Time start = Runtime::Timer::now();
+    haltSem.P(*this);
+    stats->park.count((Runtime::Timer::now() - start).toNS() / 1000);
+#else
     haltSem.P(*this);
+#endif
     return handoverFred;
   }
 
@@ -169,7 +551,7 @@ public:
   Fred& scheduleFull(_friend<Fred>);
 
   void enqueueYield(Fred& f, _friend<Fred>) { enqueueFred(f); }
-  void enqueueResume(Fred& f, BaseProcessor&proc, _friend<Fred>);
+  void enqueueResume(Fred& f, BaseProcessor&proc, bool runNext, _friend<Fred>);
 
   void reset(Scheduler& c, _friend<EventScope> token, const char* n = "Processor  ") {
     new (stats) FredStats::ProcessorStats(this, &c, n);
@@ -173,22 +173,35 @@ public:
     RASSERT0(bitcount == 1);
   }
 
+  template<bool atomic=false>
   void set( size_t idx, size_t botlevel = 0 ) {
     for (size_t l = botlevel; l < Levels; l += 1) {
       size_t r = idx % B;
       idx = idx / B;
       if (bitmaps[l][idx].test(r)) return;
-      bitmaps[l][idx].set(r);
+      bitmaps[l][idx].template set<atomic>(r);
+      if (atomic) __atomic_thread_fence(__ATOMIC_SEQ_CST); // see clr()
     }
     RASSERT0(idx == 0);
   }
 
+  // atomic: a concurrent set() below might see the summary bit before it is
+  // cleared here, so re-check the lower level after clearing and restore
+  template<bool atomic=false>
   void clr( size_t idx, size_t botlevel = 0 ) {
     for (size_t l = botlevel; l < Levels; l += 1) {
       size_t r = idx % B;
-      idx = idx / B;
-      bitmaps[l][idx].clr(r);
-      if (!bitmaps[l][idx].empty()) return;
+      size_t i = idx / B;
+      bitmaps[l][i].template clr<atomic>(r);
+      if (atomic && l > botlevel) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!bitmaps[l-1][idx].empty()) {
+          set<atomic>(idx, l);
+          return;
+        }
+      }
+      if (!bitmaps[l][i].empty()) return;
+      idx = i;
     }
     RASSERT0(idx == 0);
   }
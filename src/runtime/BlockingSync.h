@@ -242,7 +242,7 @@ class LockedSemaphore {
   SemaphoreResult internalP(const Args&... args) {
     // baton passing: counter unchanged, if blocking fails (timeout)
     if (counter < 1) return bq.block(lock, args...) ? SemaphoreSuccess : SemaphoreTimeout;
-    counter -= 1;
+    counter = counter - 1;
     lock.release();
     return SemaphoreWasOpen;
   }
@@ -292,7 +292,7 @@ public:
       if (Enqueue) next->resume();
     } else {
       if (Binary) counter = 1;
-      else counter += 1;
+      else counter = counter + 1;
       lock.release();
     }
     return next;
@@ -659,7 +659,7 @@ public:
   void release()    {
     if (ben.V()) return;
     Fred* next = sem.V<false>();
-    next->resume<DirectSwitch>();
+    next->resume<DirectSwitch,true>();
   }
 };
 
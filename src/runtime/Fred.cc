@@ -19,7 +19,11 @@
 #include "runtime-glue/RuntimeFred.h"
 
 Fred::Fred(BaseProcessor& proc)
-: stackPointer(0), processor(&proc), priority(DefaultPriority), affinity(DefaultAffinity), runState(Running) {
+: stackPointer(0), processor(&proc), priority(DefaultPriority), affinity(DefaultAffinity), runState(Running)
+#if TESTING_PREEMPTION
+, preemptLocks(0)
+#endif
+{
   processor->stats->create.count();
 }
 
@@ -90,11 +94,20 @@ void Fred::resumeDirect() {
   Context::CurrFred()->yieldResume(*this);
 }
 
-void Fred::resumeInternal() {
-  processor->enqueueResume(*this, *processor, _friend<Fred>());
+void Fred::resumeInternal(bool runNext) {
+  RuntimeDisablePreemption();
+#if TESTING_ELASTIC_WORKERS
+  // affinity: stay, retired processor reactivates for this fred, see BaseProcessor::retire()
+  if slowpath(processor->isRetired() && !affinity) processor = &processor->getScheduler().placement(_friend<Fred>());
+#endif
+  processor->enqueueResume(*this, *processor, runNext, _friend<Fred>());
+  RuntimeEnablePreemption();
 }
 
 void Fred::suspendInternal() {
+#if TESTING_STACKLESS_TASKS
+  RASSERT0(!Context::CurrProcessor().taskRunning); // tasks must not block
+#endif
   switchFred<Suspend>(Context::CurrProcessor().scheduleFull(_friend<Fred>()));
 }
 
@@ -120,9 +133,14 @@ bool Fred::yield() {
     CHECK_PREEMPTION(1);  // expect preemption still enabled
     RuntimeDisablePreemption();
     BaseProcessor& current = Context::CurrProcessor();
+    Fred* currFred = Context::CurrFred();
+#if TESTING_STACKLESS_TASKS
+    // idle fred runs pending tasks, see BaseProcessor::idleLoop()
+    Fred* nextFred = (current.taskCount && currFred != current.idleFred) ? current.idleFred : current.readyQueue.dequeue();
+#else
     Fred* nextFred = current.readyQueue.dequeue();
+#endif
     if (nextFred) {
-        Fred* currFred = Context::CurrFred();
         RuntimePreFredSwitch(*currFred, *nextFred, _friend<Fred>());
         stackSwitch(currFred, postYield, &currFred->stackPointer,
                     nextFred->stackPointer);
@@ -149,11 +167,19 @@ void Fred::idleYieldTo(Fred& nextFred, _friend<BaseProcessor>) {
   RuntimeEnablePreemption();
 }
 
+// preempted code might have cached TLS addresses -> resume on same processor
 void Fred::preempt() {
   CHECK_PREEMPTION(0);
   Fred* currFred = Context::CurrFred();
-  Fred* nextFred = Context::CurrProcessor().tryScheduleGlobal(_friend<Fred>());
-  if (currFred != nextFred) currFred->switchFred<Yield>(*nextFred);
+  BaseProcessor& proc = Context::CurrProcessor();
+  Fred* nextFred = proc.tryScheduleGlobal(_friend<Fred>());
+  if (!nextFred || nextFred == currFred) return;
+  size_t a = currFred->affinity;
+  currFred->affinity = PinnedAffinity;
+  currFred->processor = &proc;
+  proc.stats->preempt.count();
+  currFred->switchFred<Yield>(*nextFred);
+  currFred->affinity = a;
 }
 
 void Fred::terminate() {
@@ -57,6 +57,10 @@ typedef FredQueue<FredReadyLink> FredReadyQueue;
 typedef FredMPSC<FredReadyLink,false> FredReadyQueue;
 #endif
 
+#if TESTING_WORKSTEALING_DEQUE
+typedef WorkStealingDeque<Fred,256> FredDeque;
+#endif
+
 class Fred : public DoubleLink<Fred,FredLinkCount> {
 public:
   enum Priority : size_t { TopPriority = 0, DefaultPriority = 1, LowPriority = 2, NumPriority = 3 };
@@ -72,10 +76,14 @@ private:
   BaseProcessor* processor;    // next resumption on this processor
   Priority       priority;     // scheduling priority
   size_t         affinity;     // affinity to worker
+  static const size_t PinnedAffinity = 2; // preempted: no borrowing, see preempt()
 
   enum RunState : size_t { Parked = 0, Running = 1, ResumedEarly = 2 };
   RunState volatile runState;    // 0 = parked, 1 = running, 2 = early resume
   ptr_t    volatile resumeInfo;
+#if TESTING_PREEMPTION
+  size_t   preemptLocks;         // worker locks held -> not preemptible
+#endif
 
   Fred(const Fred&) = delete;
   const Fred& operator=(const Fred&) = delete;
@@ -92,7 +100,7 @@ private:
   static void postTerminate(Fred* prevFred);
 
   void resumeDirect();
-  void resumeInternal();
+  void resumeInternal(bool runNext = false);
 
   // these routines must be called with 'this' being the current fred
   void suspendInternal();
@@ -147,12 +155,13 @@ public:
     return resumeInfo;
   }
 
-  template<bool DirectSwitch = false>
+  // RunNext: place in processor's run-next slot, e.g., after I/O or lock handoff
+  template<bool DirectSwitch = false, bool RunNext = false>
   void resume() {
     size_t prev = __atomic_fetch_add(&runState, RunState(1), __ATOMIC_SEQ_CST);
     if (prev == Parked) {               // Parked -> Running
       if (DirectSwitch) resumeDirect();
-      else resumeInternal();
+      else resumeInternal(RunNext);
     } else {                            // Running -> ResumedEarly
       RASSERT(prev == Running, prev);
     }
@@ -180,6 +189,8 @@ public:
   bool  getAffinity() const { return affinity; }
   Fred* setAffinity(bool a) { affinity = a; return this; }
 
+  bool  isPinned() const { return affinity == PinnedAffinity; }
+
   // check affinity and potentially update processor during work-stealing
   bool checkAffinity(BaseProcessor& newProcessor, _friend<BaseProcessor>) {
     if (affinity) return true;
@@ -187,6 +198,17 @@ public:
     return false;
   }
 
+#if TESTING_PREEMPTION
+  void lockPreemption()    { preemptLocks += 1; }
+  bool unlockPreemption()  { RASSERT0(preemptLocks); preemptLocks -= 1; return preemptLocks == 0; }
+  bool preemptible() const { return preemptLocks == 0; }
+#endif
+
+  // move to other processor regardless of affinity, e.g., processor retired
+  void rehome(BaseProcessor& newProcessor, _friend<BaseProcessor>) {
+    processor = &newProcessor;
+  }
+
   BaseProcessor& getProcessor(_friend<EventScope>) {
     RASSERT0(processor);
     return *processor;
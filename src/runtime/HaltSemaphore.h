@@ -27,6 +27,9 @@ extern bool RuntimeWorkerPoll(BaseProcessor&);
 extern bool RuntimeWorkerTrySuspend(BaseProcessor&);
 extern void RuntimeWorkerSuspend(BaseProcessor&);
 extern void RuntimeWorkerResume(BaseProcessor&);
+#if TESTING_IO_URING_ADAPTIVE
+extern void RuntimeWorkerFlush(BaseProcessor&);
+#endif
 
 struct HaltSemaphore {
   HaltSemaphore(size_t c)     { RASSERT(c == 0, c); }
@@ -19,6 +19,7 @@
 
 #include "runtime/SpinLocks.h"
 #include "runtime/ContainerLink.h"
+#include "runtime-glue/RuntimePreemption.h"
 
 // https://doi.org/10.1145/103727.103729
 // the MCS queue can be used to construct an MCS lock or the Nemesis queue
@@ -39,7 +40,8 @@ public:
     return __atomic_compare_exchange_n(&tail, &expected, &last, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
   }
 
-  bool push(Node& first, Node& last) {
+protected:
+  bool pushLink(Node& first, Node& last) {
     RASSERT(!Next(last), FmtHex(&last));       // assume link invalidated at pop
     Node* prev = __atomic_exchange_n(&tail, &last, __ATOMIC_SEQ_CST); // swing tail to last of new element(s)
     if (!prev) return true;
@@ -47,6 +49,15 @@ public:
     return false;
   }
 
+public:
+  // consumer spins while producer is between tail swing and link: no preemption
+  bool push(Node& first, Node& last) {
+    RuntimeDisablePreemption();
+    bool empty = pushLink(first, last);
+    RuntimeEnablePreemption();
+    return empty;
+  }
+
   bool push(Node& elem) { return push(elem, elem); }
 
   Node* pop(Node& elem) {
@@ -70,9 +81,11 @@ public:
   QueueNemesis() : head(nullptr) {}
 
   bool push(Node& first, Node& last) {
-    if (!QueueMCS<Node,Next>::push(first, last)) return false;
-    __atomic_store_n(&head, &first, __ATOMIC_RELEASE);
-    return true;
+    RuntimeDisablePreemption();
+    bool empty = QueueMCS<Node,Next>::pushLink(first, last);
+    if (empty) __atomic_store_n(&head, &first, __ATOMIC_RELEASE);
+    RuntimeEnablePreemption();
+    return empty;
   }
 
   bool push(Node& elem) { return push(elem, elem); }
@@ -117,6 +130,18 @@ class QueueStub {
   Node* head;
   Node* volatile tail;
 
+  bool pushLink(Node& first, Node& last) {
+    RASSERT(!Next(last), FmtHex(&last));               // assume link invalidated at pop
+    Node* prev = __atomic_exchange_n((Node**)&tail, &last, __ATOMIC_SEQ_CST); // swing tail to last of new element(s)
+    bool empty = false;
+    if (Blocking) {                                    // BLOCKING:
+      empty = uintptr_t(prev) & 1;                     //   check empty marking
+      prev = (Node*)(uintptr_t(prev) & ~uintptr_t(1)); //   clear marking
+    }
+    Next(*prev) = &first;                              // append segments to previous tail
+    return empty;
+  }
+
   // peek/pop operate in chunks of elements and re-append stub after each chunk
   // after re-appending stub, tail points to stub, if no further insertions -> empty!
   bool checkStub() {
@@ -133,7 +158,7 @@ class QueueStub {
       while (!Next(*stub)) Pause();                 // producer in push()
       head = Next(*stub);                           // remove stub
       Next(*stub) = nullptr;                        // invalidate link
-      push(*stub);                                  // re-append stub at end
+      pushLink(*stub, *stub);                       // re-append stub at end
     }
     return true;
   }
@@ -147,15 +172,11 @@ public:
   template<bool = false>
   bool empty() const { return (head == stub && tail == stub); }
 
+  // consumer spins while producer is between tail swing and link: no preemption
   bool push(Node& first, Node& last) {
-    RASSERT(!Next(last), FmtHex(&last));               // assume link invalidated at pop
-    Node* prev = __atomic_exchange_n((Node**)&tail, &last, __ATOMIC_SEQ_CST); // swing tail to last of new element(s)
-    bool empty = false;
-    if (Blocking) {                                    // BLOCKING:
-      empty = uintptr_t(prev) & 1;                     //   check empty marking
-      prev = (Node*)(uintptr_t(prev) & ~uintptr_t(1)); //   clear marking
-    }
-    Next(*prev) = &first;                              // append segments to previous tail
+    RuntimeDisablePreemption();
+    bool empty = pushLink(first, last);
+    RuntimeEnablePreemption();
     return empty;
   }
 
@@ -182,6 +203,50 @@ public:
   }
 };
 
+// https://doi.org/10.1145/1073970.1073974 - bounded array, no resizing
+// only the owner pushes at the bottom; owner and thieves both take from the top with CAS
+// taking from the top (rather than the bottom) keeps FIFO order for the owner, similar to Go's runq
+// push() fails when the array is full, then the caller needs to place the element elsewhere
+template<typename Node, size_t N>
+class WorkStealingDeque {
+  static_assert(ispow2(N), "WorkStealingDeque size not a power of 2");
+  volatile size_t top;
+  volatile size_t bottom;
+  Node* volatile buffer[N];
+
+public:
+  WorkStealingDeque() : top(0), bottom(0) {}
+  template<bool = false>
+  bool empty() const { return size() == 0; }
+  bool full() const { return size() >= N; }    // conservative when called by owner
+
+  size_t size() const {                        // approximation when called by non-owner
+    size_t t = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+    size_t b = __atomic_load_n(&bottom, __ATOMIC_ACQUIRE);
+    return sword(b - t) > 0 ? b - t : 0;
+  }
+
+  bool push(Node& elem) {                      // owner only
+    size_t b = bottom;
+    if (b - __atomic_load_n(&top, __ATOMIC_ACQUIRE) >= N) return false;
+    __atomic_store_n(&buffer[b % N], &elem, __ATOMIC_RELAXED);
+    __atomic_store_n(&bottom, b + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  Node* steal() {                              // owner or thief
+    for (;;) {
+      size_t t = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+      size_t b = __atomic_load_n(&bottom, __ATOMIC_ACQUIRE);
+      if (sword(b - t) <= 0) return nullptr;
+      // slot cannot be reused by owner before 'top' moves past it -> CAS fails then
+      Node* elem = __atomic_load_n(&buffer[t % N], __ATOMIC_RELAXED);
+      if (__atomic_compare_exchange_n(&top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) return elem;
+      Pause();
+    }
+  }
+};
+
 template<typename T, size_t NUM=0, size_t CNT=1, typename LT=SingleLink<T,CNT>>
 using IntrusiveQueueNemesis = QueueNemesis<T,LT::template VNext<NUM>>;
 
@@ -23,11 +23,54 @@
 
 #if TESTING_GO_IDLEMANAGER
 
+// Treiber stack of parked processors, tagged pointer against ABA (48-bit virtual addresses).
+// A waker claims a processor by clearing 'parkHalting'. A processor claimed by targeted wakeup
+// stays linked and is skipped when popped. A processor that parks again while still linked is
+// only re-armed: a concurrent pop clears 'parkLinked' before trying to claim.
+class ParkingStack {
+  static const size_t TagShift = 48;
+  static_assert(sizeof(uintptr_t) == 8, "ParkingStack requires 64-bit pointers");
+  volatile uintptr_t top = 0;
+
+  static BaseProcessor* ptr(uintptr_t v) { return (BaseProcessor*)(v & bitmask<uintptr_t>(TagShift)); }
+  static uintptr_t tagged(BaseProcessor* p, uintptr_t prev) {
+    return uintptr_t(p) | ((prev >> TagShift) + 1) << TagShift;
+  }
+
+public:
+  static bool claim(BaseProcessor& p) {
+    bool exp = true;
+    return __atomic_compare_exchange_n(&p.parkHalting, &exp, false, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  }
+
+  void push(BaseProcessor& p) {
+    __atomic_store_n(&p.parkHalting, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&p.parkLinked, __ATOMIC_SEQ_CST)) return;
+    __atomic_store_n(&p.parkLinked, true, __ATOMIC_SEQ_CST);
+    uintptr_t prev = __atomic_load_n(&top, __ATOMIC_RELAXED);
+    do {
+      p.parkNext = ptr(prev);
+    } while (!__atomic_compare_exchange_n(&top, &prev, tagged(&p, prev), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+  }
+
+  BaseProcessor* pop() {
+    for (;;) {
+      uintptr_t prev = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+      BaseProcessor* p;
+      do {
+        p = ptr(prev);
+        if (!p) return nullptr;
+      } while (!__atomic_compare_exchange_n(&top, &prev, tagged(p->parkNext, prev), false, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE));
+      __atomic_store_n(&p->parkLinked, false, __ATOMIC_SEQ_CST);
+      if (claim(*p)) return p;
+    }
+  }
+};
+
 class IdleManager {
   volatile size_t spinCounter;
   volatile size_t waitCounter;
-  WorkerLock      procLock;
-  ProcessorList   waitingProcs;
+  ParkingStack    waitingProcs;
 
 public:
   void incSpinning() { __atomic_add_fetch(&spinCounter, 1, __ATOMIC_SEQ_CST); }
@@ -39,35 +82,33 @@ public:
   }
 
   void block(BaseProcessor& proc) {
-    procLock.acquire();
-    proc.setHalting(true, _friend<IdleManager>());
-    waitingProcs.push_front(proc);
-    procLock.release();
+    waitingProcs.push(proc);
     proc.halt(_friend<IdleManager>());
   }
 
   void unblock(BaseProcessor* nextProc = nullptr) {
+#if !TESTING_WAKE_FRED_WORKER
+    nextProc = nullptr;
+#endif
     while (waitCounter > 0) {
-      if (!procLock.tryAcquire()) {
+      if (!nextProc || !ParkingStack::claim(*nextProc)) nextProc = waitingProcs.pop();
+      if (!nextProc) {  // waiting processor not yet parked
         Pause();
-      } else if (waitingProcs.empty()) {
-        procLock.release();
-        Pause();
-      } else {
-        if (nextProc && nextProc->isHalting(_friend<IdleManager>())) {
-          waitingProcs.remove(*nextProc);
-        } else {
-          nextProc = waitingProcs.pop_front();
-        }
-        nextProc->setHalting(false, _friend<IdleManager>());
-        procLock.release();
-        decWaiting();
-        nextProc->wake(nullptr, _friend<IdleManager>());
-        return;
+        continue;
       }
+      decWaiting();
+      nextProc->wake(nullptr, _friend<IdleManager>());
+      return;
     }
   }
 
+  // wake 'proc' itself if parked, e.g., for freds that only it may run
+  void unblockTarget(BaseProcessor& proc) {
+    if (!ParkingStack::claim(proc)) return;
+    decWaiting();
+    proc.wake(nullptr, _friend<IdleManager>());
+  }
+
   IdleManager(cptr_t) : spinCounter(0), waitCounter(0) {}
   void reset(cptr_t, _friend<EventScope>) {}
 };
@@ -156,19 +197,58 @@ public:
 #endif
 
 class Scheduler {
+public:
+  // RoundRobin: per-processor cursor, Local: creating processor, rely on stealing
+  enum PlacementPolicy { PlaceRoundRobin, PlaceLocal };
+
 protected:
-  WorkerLock     ringLock;
+  WorkerLock     ringLock;             // ring membership only
   size_t         ringCount;
-  BaseProcessor* placeProc;
+  BaseProcessor* placeProc;            // shared cursor for placement from outside of scheduler
+  volatile size_t placeOutside;        // outside placements in progress, see quiescePlacement()
+  volatile bool   paused;              // see Cluster::pause()
+  PlacementPolicy placePolicy;
+  volatile long long idleSpinNS;       // maximum adaptive idle spin before parking
+#if TESTING_ELASTIC_WORKERS
+  size_t          activeCount;         // processors not retired
+  volatile size_t retireCredit;        // processors that may retire, see tryRetire()
+#endif
+#if TESTING_OCCUPANCY_BITMAP
+  static const size_t OccupancyMax = 4096;
+  OccupancyBitmap occupancy;
+  BaseProcessor** occupancyProcs;
+  size_t          occupancyCount;
+#endif
 
 public:
   IdleManager idleManager;
-  Scheduler() : ringCount(0), placeProc(nullptr), idleManager(this) {}
+  static const long long DefaultIdleSpinNS = 50000;
+
+  Scheduler() : ringCount(0), placeProc(nullptr), placeOutside(0), paused(false), placePolicy(PlaceRoundRobin), idleSpinNS(DefaultIdleSpinNS), idleManager(this) {
+#if TESTING_ELASTIC_WORKERS
+    activeCount = 0;
+    retireCredit = 0;
+#endif
+#if TESTING_OCCUPANCY_BITMAP
+    occupancy.init(OccupancyMax, new char[OccupancyBitmap::memsize(OccupancyMax)]());
+    occupancyProcs = new BaseProcessor*[OccupancyMax];
+    occupancyCount = 0;
+#endif
+  }
   ~Scheduler() {
     ScopedLock<WorkerLock> sl(ringLock);
     RASSERT(!ringCount, ringCount);
   }
 
+  size_t processorCount() const { return ringCount; }
+
+  PlacementPolicy getPlacementPolicy() const { return placePolicy; }
+  void setPlacementPolicy(PlacementPolicy p) { placePolicy = p; }
+
+  // upper bound for adaptive idle spinning, 0: park right away
+  long long getIdleSpin() const { return idleSpinNS; }
+  void setIdleSpin(long long ns) { idleSpinNS = ns; }
+
   void addProcessor(BaseProcessor& proc) {
     ScopedLock<WorkerLock> sl(ringLock);
     if (placeProc == nullptr) {
@@ -178,25 +258,150 @@ public:
       ProcessorRing::insert_after(*placeProc, proc);
     }
     ringCount += 1;
+#if TESTING_ELASTIC_WORKERS
+    activeCount += 1;
+#endif
+#if TESTING_OCCUPANCY_BITMAP
+    RASSERT(occupancyCount < OccupancyMax, occupancyCount);
+    occupancyProcs[occupancyCount] = &proc;
+    proc.setOccupancy(occupancy, occupancyCount, _friend<Scheduler>());
+    occupancyCount += 1;
+#endif
   }
 
+  // caller has paused the cluster and holds ringLock: no placement cursor moves concurrently
   void removeProcessor(BaseProcessor& proc) {
-    ScopedLock<WorkerLock> sl(ringLock);
+    RASSERT0(paused);
     RASSERT0(placeProc);
-    // move placeProc, if necessary
+    // move cursors off 'proc', if necessary
+    BaseProcessor* p = placeProc;
+    for (size_t i = 0; i < ringCount; i += 1) {
+      p->resetPlacement(proc, _friend<Scheduler>());
+      p = ProcessorRing::next(*p);
+    }
     if (placeProc == &proc) placeProc = ProcessorRing::next(*placeProc);
     // ring empty?
     if (placeProc == &proc) placeProc = nullptr;
     ProcessorRing::remove(proc);
     ringCount -= 1;
+#if TESTING_ELASTIC_WORKERS
+    if (!proc.isRetired()) activeCount -= 1;
+#endif
+#if TESTING_OCCUPANCY_BITMAP
+    for (size_t idx = 0; idx < occupancyCount; idx += 1) {
+      if (occupancyProcs[idx] == &proc) occupancyProcs[idx] = nullptr;
+    }
+#endif
   }
 
-  BaseProcessor& placement(_friend<Fred>) {
-    // ring insert is traversal-safe, so could use separate 'placeLock' here
+#if TESTING_ELASTIC_WORKERS
+  size_t activeProcessorCount() const { return activeCount; }
+
+  // allow one idle processor to retire
+  void requestRetire() { retireCredit = 1; }
+
+  // called by idle processor: no blocking on ringLock, since pause() holds it
+  bool tryRetire(BaseProcessor& proc, _friend<BaseProcessor>) {
+    if (!retireCredit || !ringLock.tryAcquire()) return false;
+    bool retire = retireCredit && activeCount > 1;
+    if (retire) {
+      retireCredit = 0;
+      activeCount -= 1;
+      proc.setRetired(true, _friend<Scheduler>());
+    }
+    ringLock.release();
+    return retire;
+  }
+
+  // retiring processor holds fred with affinity: stays active
+  void cancelRetire(BaseProcessor& proc, _friend<BaseProcessor>) {
     ScopedLock<WorkerLock> sl(ringLock);
-    RASSERT0(placeProc);
-    placeProc = ProcessorRing::next(*placeProc);
-    return *placeProc;
+    if (!proc.isRetired()) return;                      // reactivated concurrently
+    activeCount += 1;
+    proc.setRetired(false, _friend<Scheduler>());
+  }
+
+  // reactivate one retired processor, false if there is none
+  bool reactivateProcessor() {
+    ScopedLock<WorkerLock> sl(ringLock);
+    retireCredit = 0;
+    BaseProcessor* p = placeProc;
+    for (size_t i = 0; i < ringCount; i += 1) {
+      if (p->isRetired()) {
+        activeCount += 1;
+        p->setRetired(false, _friend<Scheduler>());
+        return true;
+      }
+      p = ProcessorRing::next(*p);
+    }
+    return false;
+  }
+#endif
+
+#if TESTING_OCCUPANCY_BITMAP
+  // index of next processor with ready freds, starting at 'idx', limit<size_t>() if none
+  size_t findOccupied(size_t idx) const {
+    return idx < occupancyCount ? occupancy.findnext(idx) : limit<size_t>();
+  }
+  BaseProcessor* getOccupied(size_t idx) const { return occupancyProcs[idx]; }
+  size_t getOccupancyCount() const { return occupancyCount; }
+#endif
+
+  // no lock: ring insert is traversal-safe, removal requires Cluster::pause()
+  BaseProcessor& placement(_friend<Fred>) { return placeNext(); }
+
+#if TESTING_STACKLESS_TASKS
+  // place task like a new fred
+  void enqueueTask(Task& t) {
+    BaseProcessor& proc = placeNext();
+    proc.enqueueTask(t, _friend<Scheduler>());
+    idleManager.unblock(&proc);
+  }
+#endif
+
+private:
+  BaseProcessor& placeNext() {
+    BaseProcessor* cp = Context::CurrProcessorOrNull();
+    if (cp && &cp->getScheduler() == this) {
+#if TESTING_LOADBALANCING
+      if (placePolicy == PlaceLocal) return *cp;
+#endif
+      return cp->advancePlacement(_friend<Scheduler>());
+    }
+    // announce outside placement, then check for pause: pairs with quiescePlacement()
+    __atomic_add_fetch(&placeOutside, 1, __ATOMIC_SEQ_CST);
+    if slowpath(__atomic_load_n(&paused, __ATOMIC_SEQ_CST)) {
+      __atomic_sub_fetch(&placeOutside, 1, __ATOMIC_SEQ_CST);
+      ScopedLock<WorkerLock> sl(ringLock); // held by Cluster::pause() until resume
+      return placeOutsideNext();
+    }
+    BaseProcessor& proc = placeOutsideNext();
+    __atomic_sub_fetch(&placeOutside, 1, __ATOMIC_RELEASE);
+    return proc;
+  }
+
+  BaseProcessor& placeOutsideNext() {
+    BaseProcessor* p = __atomic_load_n(&placeProc, __ATOMIC_RELAXED);
+    for (;;) {
+      RASSERT0(p);
+      BaseProcessor* n = ProcessorRing::next(*p);
+      if (__atomic_compare_exchange_n(&placeProc, &p, n, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+#if TESTING_ELASTIC_WORKERS
+        if (n->isRetired()) {
+          p = n;
+          continue;
+        }
+#endif
+        return *n;
+      }
+    }
+  }
+
+protected:
+  // caller holds ringLock and has stopped all other workers
+  void quiescePlacement(bool pause) {
+    __atomic_store_n(&paused, pause, __ATOMIC_SEQ_CST);
+    if (pause) while (__atomic_load_n(&placeOutside, __ATOMIC_SEQ_CST)) Pause();
   }
 };
 
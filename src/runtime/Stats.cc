@@ -136,7 +136,8 @@ void PollerStats::print(ostream& os) const {
 void IOUringStats::print(ostream& os) const {
   if (totalIOUringStats && this != totalIOUringStats) totalIOUringStats->aggregate(*this);
   Base::print(os);
-  os << " attempts:" << attempts << " submits:" << submits << " eventsB:" << eventsB << " eventsNB:" << eventsNB;
+  os << " attempts:" << attempts << " submits:" << submits << " eventsB:" << eventsB << " eventsNB:" << eventsNB << " multishot:" << multishot
+     << " delay:" << delay << " full:" << flushFull << " deadline:" << flushDeadline << " idle:" << flushIdle;
 }
 
 void TimerStats::print(ostream& os) const {
@@ -149,6 +150,7 @@ void ClusterStats::print(ostream& os) const {
   if (totalClusterStats && this != totalClusterStats) totalClusterStats->aggregate(*this);
   Base::print(os);
   os << " pause: " << pause;
+  if (elastic) os << " elastic:" << elastic;
 }
 
 void IdleManagerStats::print(ostream& os) const {
@@ -166,8 +168,21 @@ void ProcessorStats::print(ostream& os) const {
   if (handover)     os << " H: "  << handover;
   if (borrow)       os << " B: "  << borrow;
   if (steal)        os << " S: "  << steal;
+  if (stealBatch)   os << " SB: " << stealBatch;
+  if (stealBatch) {
+    os << " SL: " << stealLevel[0];
+    for (size_t l = 1; l < StealLevels; l += 1) os << '/' << stealLevel[l];
+  }
   os << " I: " << idle;
   os << " W: " << wake;
+  if (spinHit || spinMiss) os << " SH: " << spinHit << " SM: " << spinMiss;
+  if (park)         os << " P:" << park;
+  if (preempt)      os << " PR: " << preempt;
+  if (retire)       os << " RT: " << retire;
+  if (stackHit || stackMiss) os << " SC: " << stackHit << '/' << stackMiss;
+  if (stackReclaim) os << " SR: " << stackReclaim;
+  if (task)         os << " T: " << task;
+  if (taskSteal)    os << " TS: " << taskSteal;
 }
 
 void ReadyQueueStats::print(ostream& os) const {
@@ -176,6 +191,11 @@ void ReadyQueueStats::print(ostream& os) const {
   os << queue;
 }
 
+void StackStats::print(ostream& os) const {
+  Base::print(os);
+  os << ' ' << label << " depth:" << depth << " max: " << max;
+}
+
 #else
 
 void StatsClear(int) {}
@@ -61,7 +61,7 @@ public:
     __atomic_add_fetch( &cnt, n, __ATOMIC_RELAXED);
   }
   void aggregate(const Counter& x) {
-    cnt += x.cnt;
+    cnt = cnt + x.cnt;
   }
   void reset() {
     cnt = 0;
@@ -96,8 +96,8 @@ public:
   }
   void aggregate(const Average& x) {
     Counter::aggregate(x);
-    sum += x.sum;
-    sqsum += x.sqsum;
+    sum = sum + x.sum;
+    sqsum = sqsum + x.sqsum;
   }
   void reset() {
     cnt = 0;
@@ -186,7 +186,7 @@ public:
     tryfails.count();
   }
   void aggregate(const Queue& x) {
-    qlen += x.qlen;
+    qlen = qlen + x.qlen;
     fails.aggregate(x.fails);
     tryfails.aggregate(x.tryfails);
     qdist.aggregate(x.qdist);
@@ -296,6 +296,11 @@ struct IOUringStats : public Base {
   Distribution submits;
   Distribution eventsB;
   Distribution eventsNB;
+  Counter multishot;
+  Distribution delay;
+  Counter flushFull;
+  Counter flushDeadline;
+  Counter flushIdle;
   IOUringStats(cptr_t o, cptr_t p, const char* n = "IOUring") : Base(o, p, n, 1) {}
   void print(ostream& os) const;
   void aggregate(const IOUringStats& x) {
@@ -303,12 +308,22 @@ struct IOUringStats : public Base {
     submits.aggregate(x.submits);
     eventsB.aggregate(x.eventsB);
     eventsNB.aggregate(x.eventsNB);
+    multishot.aggregate(x.multishot);
+    delay.aggregate(x.delay);
+    flushFull.aggregate(x.flushFull);
+    flushDeadline.aggregate(x.flushDeadline);
+    flushIdle.aggregate(x.flushIdle);
   }
   virtual void reset() {
     attempts.reset();
     submits.reset();
     eventsB.reset();
     eventsNB.reset();
+    multishot.reset();
+    delay.reset();
+    flushFull.reset();
+    flushDeadline.reset();
+    flushIdle.reset();
   }
 };
 
@@ -326,13 +341,16 @@ struct TimerStats : public Base {
 
 struct ClusterStats : public Base {
   Counter pause;
+  Average elastic; // active workers per elastic period
   ClusterStats(cptr_t o, cptr_t p, const char* n = "Cluster     ") : Base(o, p, n, 2) {}
   void print(ostream& os) const;
   void aggregate(const ClusterStats& x) {
     pause.aggregate(x.pause);
+    elastic.aggregate(x.elastic);
   }
   virtual void reset() {
     pause.reset();
+    elastic.reset();
   }
 };
 
@@ -352,14 +370,27 @@ struct IdleManagerStats : public Base {
 };
 
 struct ProcessorStats : public Base {
+  static const size_t StealLevels = 4; // see BaseProcessor::StealLevel
   Counter create;
   Counter start;
   Counter deq;
   Counter handover;
   Counter borrow;
   Counter steal;
+  Average stealBatch;
+  Counter stealLevel[StealLevels];
   Counter idle;
   Counter wake;
+  Counter spinHit;
+  Counter spinMiss;
+  Average park;   // microseconds
+  Counter preempt;
+  Counter retire;
+  Counter stackHit;
+  Counter stackMiss;
+  Counter stackReclaim; // bytes
+  Counter task;
+  Counter taskSteal;
   ProcessorStats(cptr_t o, cptr_t p, const char* n = "Processor  ") : Base(o, p, n, 2) {}
   void print(ostream& os) const;
   void aggregate(const ProcessorStats& x) {
@@ -369,8 +400,20 @@ struct ProcessorStats : public Base {
     handover.aggregate(x.handover);
     borrow.aggregate(x.borrow);
     steal.aggregate(x.steal);
+    stealBatch.aggregate(x.stealBatch);
+    for (size_t l = 0; l < StealLevels; l += 1) stealLevel[l].aggregate(x.stealLevel[l]);
     idle.aggregate(x.idle);
     wake.aggregate(x.wake);
+    spinHit.aggregate(x.spinHit);
+    spinMiss.aggregate(x.spinMiss);
+    park.aggregate(x.park);
+    preempt.aggregate(x.preempt);
+    retire.aggregate(x.retire);
+    stackHit.aggregate(x.stackHit);
+    stackMiss.aggregate(x.stackMiss);
+    stackReclaim.aggregate(x.stackReclaim);
+    task.aggregate(x.task);
+    taskSteal.aggregate(x.taskSteal);
   }
   virtual void reset() {
     create.reset();
@@ -379,8 +422,20 @@ struct ProcessorStats : public Base {
     handover.reset();
     borrow.reset();
     steal.reset();
+    stealBatch.reset();
+    for (size_t l = 0; l < StealLevels; l += 1) stealLevel[l].reset();
     idle.reset();
     wake.reset();
+    spinHit.reset();
+    spinMiss.reset();
+    park.reset();
+    preempt.reset();
+    retire.reset();
+    stackHit.reset();
+    stackMiss.reset();
+    stackReclaim.reset();
+    task.reset();
+    taskSteal.reset();
   }
 };
 
@@ -396,6 +451,22 @@ struct ReadyQueueStats : public Base {
   }
 };
 
+struct StackStats : public Base {
+  const char* label;  // fibre name
+  Distribution depth; // bytes
+  Number max;         // updated by owner under lock
+  StackStats(cptr_t o, cptr_t p, const char* l, const char* n = "Stack      ") : Base(o, p, n, 3), label(l), max(0) {}
+  void print(ostream& os) const;
+  void count(Number d) {
+    depth.count(d);
+    if (d > max) max = d;
+  }
+  virtual void reset() {
+    depth.reset();
+    max = 0;
+  }
+};
+
 } // namespace FredStats
 
 /*
@@ -405,6 +476,7 @@ struct ReadyQueueStats : public Base {
   0 IOUring
   1 Timer
   2 Cluster
+  3 Stack
   0  Poller
   1  IdleManager
   2  Processor
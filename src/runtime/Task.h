@@ -0,0 +1,43 @@
+/******************************************************************************
+    Copyright (C) Martin Karsten 2015-2023
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+#ifndef _Task_h_
+#define _Task_h_ 1
+
+#include "runtime/LockFreeQueues.h"
+
+/*
+A task is a stackless, run-to-completion work item.  Tasks are queued per
+processor and executed by the idle loop directly on the idle fred's stack,
+without context switch.  A task must not block: blocking would suspend the
+idle fred.  The runtime does not manage task memory, 'func' is the last
+access to a task by the runtime.
+*/
+class Task : public SingleLink<Task> {
+public:
+  typedef void (*Func)(Task&);
+
+private:
+  Func func;
+
+public:
+  Task(Func f) : func(f) {}
+  void run() { func(*this); }
+};
+
+typedef IntrusiveQueueNemesis<Task> TaskQueue;
+
+#endif /* _Task_h_ */
@@ -3,6 +3,7 @@
 #define TESTING_ENABLE_ASSERTIONS     0
 #define TESTING_ENABLE_STATISTICS     0
 #define TESTING_ENABLE_DEBUGGING      0
+//#define TESTING_PARK_STATISTICS       1 // park durations in ProcessorStats: two clock reads per park
 
 // **** general options - alternative design
 
@@ -12,6 +13,11 @@
 //#define TESTING_WAKE_FRED_WORKER      1 // idle manager: wake fred's worker vs any worker
 //#define TESTING_LOCKED_READYQUEUE     1 // locked vs. lock-free ready queue
 //#define TESTING_STUB_QUEUE            1 // nemesis vs. stub-based MPSC lock-free queue
+//#define TESTING_WORKSTEALING_DEQUE    1 // per-processor work-stealing deque plus MPSC inbox
+//#define TESTING_OCCUPANCY_BITMAP      1 // thieves only visit processors marked in ready bitmap
+//#define TESTING_RUNNEXT               1 // run-next slot for freds resumed by I/O or lock handoff
+//#define TESTING_ELASTIC_WORKERS       1 // retire/reactivate workers by load, see Cluster::setElastic
+//#define TESTING_STACKLESS_TASKS       1 // run-to-completion tasks on idle stack, see Task.h
 
 #include "runtime-glue/testoptions.h"
 
@@ -23,6 +29,31 @@
 
 /******************************** sanity checks ********************************/
 
+#if TESTING_PARK_STATISTICS && !TESTING_ENABLE_STATISTICS
+  #error TESTING_PARK_STATISTICS requires TESTING_ENABLE_STATISTICS
+#endif
+
 #if TESTING_WAKE_FRED_WORKER && !TESTING_LOADBALANCING
   #error TESTING_WAKE_FRED_WORKER requires TESTING_LOADBALANCING
 #endif
+
+#if TESTING_WORKSTEALING_DEQUE && !TESTING_LOADBALANCING
+  #error TESTING_WORKSTEALING_DEQUE requires TESTING_LOADBALANCING
+#endif
+
+#if TESTING_OCCUPANCY_BITMAP && !TESTING_LOADBALANCING
+  #error TESTING_OCCUPANCY_BITMAP requires TESTING_LOADBALANCING
+#endif
+
+#if TESTING_ELASTIC_WORKERS
+ #if !TESTING_LOADBALANCING || !TESTING_GO_IDLEMANAGER
+  #error TESTING_ELASTIC_WORKERS requires TESTING_LOADBALANCING and TESTING_GO_IDLEMANAGER
+ #endif
+ #if TESTING_WORKER_POLLER || TESTING_WORKER_IO_URING
+  #error TESTING_ELASTIC_WORKERS cannot be combined with per-worker polling
+ #endif
+#endif
+
+#if TESTING_STACKLESS_TASKS && (!TESTING_LOADBALANCING || !TESTING_GO_IDLEMANAGER)
+  #error TESTING_STACKLESS_TASKS requires TESTING_LOADBALANCING and TESTING_GO_IDLEMANAGER
+#endif